@@ -5,27 +5,47 @@
  * along with some linked list utitlites that don't depend on the type of the
  * list.
  *
- * To use, define the parameters described below, and include <stdlib.h> to
- * define malloc which is used by the constructor. stdlib only needs to be
- * included in the file that defines the implementation (details below).
+ * To use, define the parameters described below and include list.h, which
+ * includes <stdlib.h> for malloc and free and <string.h> itself.
  *
  * PARAMETERS:
  *  TYPE
  *  TYPE_PTR
+ *  LIST_CHUNK_SIZE
+ *  KEY_TYPE, KEY_OF, KEY_HASH, KEY_EQ
  *  _LIST_HEADER
  *  _LIST_IMPLEMENTATION
  *
  * To compile this library you must define the following macros:
  *   TYPE
  *   TYPE_PTR (optional)
+ *   LIST_CHUNK_SIZE (optional)
+ *   LIST_INLINE_CAPACITY (optional)
+ *   LIST_STATS (optional)
+ *   TYPE_TRIVIAL (optional)
+ *   KEY_TYPE, KEY_OF, KEY_HASH, KEY_EQ (optional)
  *
  * TYPE controls the type of the link list implementation to be generated
  * TYPE_PTR should be a name that TYPE can be safely typedef'd to to prevent
  *   invalid syntax in the case that TYPE contains a '*'
+ * LIST_CHUNK_SIZE sets the number of entries per node of the unrolled list
+ *   variant (list_chunk_sentinal_TYPE), 16 if not defined
+ * LIST_INLINE_CAPACITY embeds that many node slots in list_sentinal_TYPE,
+ *   see "Inline nodes" below, 0 if not defined
+ * LIST_STATS adds operation counters to list_sentinal_TYPE, see
+ *   "List statistics" below
+ * TYPE_TRIVIAL declares that elements of TYPE never need a destructor, see
+ *   "Trivial types" below
+ * KEY_TYPE, KEY_OF, KEY_HASH and KEY_EQ generate the key indexed variant
+ *   (list_indexed_TYPE), see "Key indexed list" below
  *
  * Note: you can create lists for multiple types by redefining TYPE and
  * re-including list.h
  *
+ * Nodes are allocated with malloc unless the list is created with
+ * new_list_alloc, in which case they come from the given struct
+ * list_allocator. struct list_pool is a ready made fixed size node pool.
+ *
  * The macros _LIST_HEADER and _LIST_IMPLEMENTATION are useful for including
  * this library in header files. Defining _LIST_HEADER before including will
  * only define everything except function bodies (creating only a prototype
@@ -40,7 +60,7 @@
  *
  * ```
  * #include <stdio.h>
- * #include <stlib.h>
+ * #include <stdlib.h>
  *
  * #define TYPE int
  * #include "list.h"
@@ -93,318 +113,4267 @@ EXPAND1(PTR_HACK, TYPE, TYPE_PTR)
 #define TYPE TYPEHACK(TYPE_PTR)
 #endif
 
-#ifndef _LIST_IMPLEMENTATION
 /**
- * Defines parametrized list type
+ * Type independent definitions
  *
- * @param T type parameter for list
+ * Everything in this block is shared by every list type and is therefore only
+ * defined the first time list.h is included.
  */
-#define LIST_DEFN(T)                                                           \
-  struct list_##T {                                                            \
-    struct list_##T *next;                                                     \
-    struct list_##T *prev;                                                     \
-    T entry; /* Variable length struct */                                      \
-  };
-EXPAND(LIST_DEFN, TYPE)
-#undef LIST_DEFN
+#ifndef _LIST_COMMON
+#define _LIST_COMMON
+
+// For malloc and free, used by the allocators inline below
+#include <stdlib.h>
+// For memcpy and memset, used by the deque and bulk operations
+#include <string.h>
 
 /**
- * Define destructor type
+ * Node allocator
  *
- * @param T type parameter for list
+ * Lists allocate and release their nodes through an allocator when one is
+ * attached to the list sentinal (see new_list_alloc), and through
+ * malloc/free otherwise.
+ *
+ * alloc - returns at least size bytes suitably aligned for a list node
+ * free - releases ptr, size is the same size that was passed to alloc
+ * ctx - opaque pointer passed as the first argument to alloc and free
+ * block_size - optional, nonzero if requests of up to block_size bytes take a
+ *   block of exactly that size and larger ones go to malloc, as they do for
+ *   struct list_pool. Only used to estimate memory usage.
  */
-#define LIST_DESTRUCTOR(T) typedef void (*list_destructor_##T)(T);
-EXPAND(LIST_DESTRUCTOR, TYPE)
-#undef LIST_DESTRUCTOR
+struct list_allocator {
+  void *(*alloc)(void *ctx, size_t size);
+  void (*free)(void *ctx, void *ptr, size_t size);
+  void *ctx;
+  size_t block_size;
+};
 
 /**
- * Define list metadata container struct
+ * Fixed size node pool
  *
- * @param T type parameter for list
+ * Hands out nodes of node_size bytes from slabs of slab_nodes nodes each.
+ * Released nodes are kept on a free list and reused by later allocations, so
+ * once the pool has grown to the working set of its lists, appending and
+ * popping never call malloc. Requests larger than node_size fall through to
+ * malloc.
+ *
+ * The pool may be shared by any number of lists whose nodes fit in node_size,
+ * and must outlive all of them. Attach it to a list with:
+ *
+ * ```
+ * struct list_pool pool;
+ * list_pool_init(&pool, sizeof(struct list_int), 1024);
+ * struct list_sentinal_int list = new_list_alloc(int, NULL, &pool.allocator);
+ * ...
+ * LIST_DESTROY(&list);
+ * list_pool_destroy(&pool);
+ * ```
  */
-#define LIST_SENTINALS(T)                                                      \
-  struct list_sentinal_##T {                                                   \
-    struct list_##T *head;                                                     \
-    struct list_##T *tail;                                                     \
-    size_t length;                                                             \
-    list_destructor_##T destructor;                                            \
-  };
-EXPAND(LIST_SENTINALS, TYPE)
-#undef LIST_SENTINALS
+struct list_pool {
+  struct list_allocator allocator;
+  size_t node_size;
+  size_t slab_nodes;
+  void *free_nodes; /* Linked through the first word of each free node */
+  void *slabs;      /* Linked through the first word of each slab */
+};
+
+// Offset of the first node in a pool slab
+#define _LIST_POOL_SLAB_HEADER                                                 \
+  ((sizeof(void *) + __BIGGEST_ALIGNMENT__ - 1) &                              \
+   ~(size_t)(__BIGGEST_ALIGNMENT__ - 1))
 
 /**
- * Generic list add
+ * Adds a slab to the pool and threads its nodes onto the free list
  *
- * For internal use only - see LIST_APPEND and LIST_PREPEND
+ * @return 0 if the slab could not be allocated
+ *
+ * @param pool pool to grow
  */
-#define _LIST_ADD(list, elem, top, bottom, direction, reverse)                 \
-  ({                                                                           \
-    typeof(*((list)->head)) *new_entry = malloc(sizeof(*new_entry));           \
-    new_entry->next = NULL;                                                    \
-    new_entry->prev = NULL;                                                    \
-    new_entry->entry = elem;                                                   \
-    if (!(list)->bottom)                                                       \
-      (list)->bottom = new_entry;                                              \
-    if (!(list)->top)                                                          \
-      (list)->top = new_entry;                                                 \
-    else {                                                                     \
-      (list)->top->direction = new_entry;                                      \
-      new_entry->reverse = (list)->top;                                        \
-      (list)->top = new_entry;                                                 \
-    }                                                                          \
-    ++(list)->length;                                                          \
-  })
+static inline int list_pool_grow(struct list_pool *pool) {
+  char *slab =
+      malloc(_LIST_POOL_SLAB_HEADER + pool->node_size * pool->slab_nodes);
+  if (!slab)
+    return 0;
+  *(void **)slab = pool->slabs;
+  pool->slabs = slab;
+  // Thread in reverse so nodes are handed out in address order
+  for (size_t i = pool->slab_nodes; i-- > 0;) {
+    void *node = slab + _LIST_POOL_SLAB_HEADER + i * pool->node_size;
+    *(void **)node = pool->free_nodes;
+    pool->free_nodes = node;
+  }
+  return 1;
+}
 
 /**
- * Append an element to the tail of the list
+ * Pool allocation callback - see struct list_allocator
+ */
+static inline void *list_pool_alloc(void *ctx, size_t size) {
+  struct list_pool *pool = ctx;
+  if (size > pool->node_size)
+    return malloc(size);
+  if (!pool->free_nodes && !list_pool_grow(pool))
+    return NULL;
+  void *node = pool->free_nodes;
+  pool->free_nodes = *(void **)node;
+  return node;
+}
+
+/**
+ * Pool release callback - see struct list_allocator
+ */
+static inline void list_pool_free(void *ctx, void *ptr, size_t size) {
+  struct list_pool *pool = ctx;
+  if (size > pool->node_size) {
+    free(ptr);
+    return;
+  }
+  *(void **)ptr = pool->free_nodes;
+  pool->free_nodes = ptr;
+}
+
+/**
+ * Pool constructor
  *
- * @return size_t length of new list
+ * The pool is initialized in place since its allocator refers back to it.
+ * No memory is allocated until the first node is requested.
  *
- * @param list list_sentinal_type storing list metadata
- * @param elem element of the same type as the list to append (not of type
- *list_type)
+ * @param pool pool to initialize
+ * @param node_size size of the nodes to hand out, e.g. sizeof(struct list_int)
+ * @param slab_nodes number of nodes to allocate each time the pool runs dry
+ */
+static inline void list_pool_init(struct list_pool *pool, size_t node_size,
+                                  size_t slab_nodes) {
+  if (node_size < sizeof(void *))
+    node_size = sizeof(void *);
+  // Keep every node in a slab aligned like the first one
+  node_size = (node_size + __BIGGEST_ALIGNMENT__ - 1) &
+              ~(size_t)(__BIGGEST_ALIGNMENT__ - 1);
+  pool->node_size = node_size;
+  pool->slab_nodes = slab_nodes ? slab_nodes : 1;
+  pool->free_nodes = NULL;
+  pool->slabs = NULL;
+  pool->allocator.alloc = list_pool_alloc;
+  pool->allocator.free = list_pool_free;
+  pool->allocator.ctx = pool;
+  pool->allocator.block_size = node_size;
+}
+
+/**
+ * Pool destructor
  *
- * e.g.
+ * Releases every slab at once. Any list still using the pool must not be
+ * touched afterwards.
  *
- * struct list_sentinal_int my_list = new_list_int(NULL, 0, NULL);
- * LIST_APPPEND(&my_list, 5);
- **
+ * @param pool pool to destroy
  */
-#define LIST_APPEND(list, elem) _LIST_ADD(list, elem, tail, head, next, prev)
+static inline void list_pool_destroy(struct list_pool *pool) {
+  while (pool->slabs) {
+    void *next = *(void **)pool->slabs;
+    free(pool->slabs);
+    pool->slabs = next;
+  }
+  pool->free_nodes = NULL;
+}
 
 /**
- * Prepend an element to the head of the list
+ * Bulk node slab
  *
- * @return size_t length of new list
+ * Nodes allocated in bulk (see LIST_APPEND_ARRAY) are carved out of a single
+ * block that starts with this header. Every node records the slab it was
+ * carved out of, NULL for nodes allocated on their own, so freeing a node
+ * finds its slab in O(1). The slab is released with its last node, whichever
+ * list that node has moved to in the meantime.
  *
- * @param list pointer to list_sentinal_type storing list metadata
- * @param elem element of the same type as the list to prepend (not of type
- * list_type)
+ * live - nodes in the slab that have not been freed yet
+ * bytes - size of the whole block including this header
+ * allocator - allocator the block came from, NULL for malloc
+ * marked - scratch flag for LIST_MEMORY_USAGE
+ */
+struct list_slab {
+  size_t live;
+  size_t bytes;
+  struct list_allocator *allocator;
+  int marked;
+};
+
+// Offset of the first node in a bulk slab
+#define _LIST_SLAB_HEADER                                                      \
+  ((sizeof(struct list_slab) + __BIGGEST_ALIGNMENT__ - 1) &                    \
+   ~(size_t)(__BIGGEST_ALIGNMENT__ - 1))
+
+// First node of a bulk slab
+#define _LIST_SLAB_NODES(slab) ((void *)((char *)(slab) + _LIST_SLAB_HEADER))
+
+/**
+ * Allocates a slab of count nodes
  *
- * e.g.
+ * @return the slab, whose nodes start at _LIST_SLAB_NODES(slab), or NULL
  *
- * struct list_sentinal_int my_list = new_list_int(NULL, 0, NULL);
- * LIST_PREPEND(&my_list, 5);
+ * @param allocator allocator for the block, NULL for malloc
+ * @param node_size size of a single node
+ * @param count number of nodes
+ */
+static inline struct list_slab *list_slab_new(struct list_allocator *allocator,
+                                              size_t node_size, size_t count) {
+  size_t bytes = _LIST_SLAB_HEADER + node_size * count;
+  struct list_slab *slab =
+      allocator ? allocator->alloc(allocator->ctx, bytes) : malloc(bytes);
+  if (!slab)
+    return NULL;
+  slab->live = count;
+  slab->bytes = bytes;
+  slab->allocator = allocator;
+  slab->marked = 0;
+  return slab;
+}
+
+/**
+ * Returns one node to its slab, releasing the slab with the last one
  *
+ * @param slab slab the node was carved out of
  */
-#define LIST_PREPEND(list, elem) _LIST_ADD(list, elem, head, tail, prev, next)
+static inline void list_slab_put(struct list_slab *slab) {
+  if (--slab->live)
+    return;
+  if (slab->allocator)
+    slab->allocator->free(slab->allocator->ctx, slab, slab->bytes);
+  else
+    free(slab);
+}
 
 /**
- * Append an array to a list element by element.
+ * Generic node allocation
  *
- * @return pointer to the list passed in
+ * For internal use only - allocates size bytes through the list's allocator
+ */
+#define _LIST_ALLOC(list, size)                                                \
+  ((list)->allocator                                                           \
+       ? (list)->allocator->alloc((list)->allocator->ctx, size)                \
+       : malloc(size))
+
+/**
+ * Generic node release
  *
- * @param list pointer list to append array to
- * @param array elements to append to list
- * @param len length of array
+ * For internal use only - releases ptr through the list's allocator
  */
-#define LIST_APPEND_ARRAY(list, array, len)                                    \
+#define _LIST_FREE(list, ptr, size)                                            \
   ({                                                                           \
-    for (size_t __i = 0; __i < len; __i++) {                                   \
-      LIST_APPEND(list, array[__i]);                                           \
-    }                                                                          \
-    list;                                                                      \
+    if ((list)->allocator)                                                     \
+      (list)->allocator->free((list)->allocator->ctx, ptr, size);              \
+    else                                                                       \
+      free(ptr);                                                               \
   })
 
 /**
- * Prepend an array to a list element by element.
+ * Marks the following for loop as a parallel loop over nthreads threads
  *
- * @return pointer to the list passed in
+ * For internal use only - see LIST_PARALLEL_FOR_EACH. Expands to an OpenMP
+ * pragma when compiled with -fopenmp and to nothing otherwise, in which case
+ * the loop runs serially.
+ */
+#ifdef _OPENMP
+#define _LIST_PRAGMA(x) _Pragma(#x)
+#define _LIST_PARALLEL_FOR(nthreads)                                           \
+  _LIST_PRAGMA(omp parallel for num_threads(nthreads) schedule(static))
+#else
+#define _LIST_PARALLEL_FOR(nthreads)
+#endif
+
+/**
+ * Most ranges, and threads, the parallel iterators split a list into
  *
- * @param list pointer list to prepend array to
- * @param array elements to prepend to list
- * @param len length of array
+ * For internal use only - bounds the range starts LIST_PARALLEL_FOR_EACH
+ * keeps on the stack, whatever the caller passes as nthreads.
  */
-#define LIST_PREPEND_ARRAY(list, array, len)                                   \
-  ({                                                                           \
-    for (size_t __i = 0; __i < len; __i++) {                                   \
-      LIST_PREPEND(list, array[__i]);                                          \
-    }                                                                          \
-    list;                                                                      \
-  })
+#define _LIST_PARALLEL_MAX_THREADS 256
 
 /**
- * Deletes an element from the list
+ * Marks the following loop as a SIMD loop with the given OpenMP clauses
  *
- * @param list pointer to list_sentinal_type storing list metadata
- * @param elem pointer to list_type of element to delete
+ * For internal use only - see the span kernels below. Expands to nothing
+ * without -fopenmp, in which case vectorization is left to the compiler.
  */
-#define LIST_DEL(list, elem)                                                   \
-  ({                                                                           \
-    LIST_REMOVE(list, elem);                                                   \
-    if ((list)->destructor)                                                    \
-      (list)->destructor((elem)->entry);                                       \
-    free(elem);                                                                \
-  })
+#ifdef _OPENMP
+#define _LIST_SIMD(clauses) _LIST_PRAGMA(omp simd clauses)
+#else
+#define _LIST_SIMD(clauses)
+#endif
 
 /**
- * Removes an element from a list without deleteing it
+ * Span kernels
  *
- * @return size_t new length of list
+ * For internal use only - see LIST_CHUNK_SUM and DEQUE_SUM and friends.
  *
- * @param list pointer to list_sentinal_type storing list metadata
- * @param elem pointer to list_type of element to remove
+ * Each kernel runs over the n elements (base)[i] member, where member is
+ * empty for arrays of entries or .entry for arrays of deque entries. The
+ * loops have no early exits and no calls so that they vectorize: at -O3,
+ * with -ftree-vectorize, or with -fopenmp where they also carry an omp simd
+ * pragma, which lets floating point sums and minimums be reordered.
+ * _LIST_SPAN_FIND scans a block at a time without branching and only
+ * searches a block element by element once it is known to hold a match.
  */
-#define LIST_REMOVE(list, elem)                                                \
-  ({                                                                           \
-    if ((elem)->prev)                                                          \
-      (elem)->prev->next = (elem)->next;                                       \
-    if ((elem)->next)                                                          \
-      (elem)->next->prev = (elem)->prev;                                       \
-    if ((elem) == (list)->head)                                                \
-      (list)->head = (list)->head->next;                                       \
-    if ((elem) == (list)->tail)                                                \
-      (list)->tail = (list)->tail->prev;                                       \
-    (list)->length--;                                                          \
-  })
+#define _LIST_SPAN_SUM(base, n, member, acc)                                   \
+  do {                                                                         \
+    size_t __list_span_n = (n);                                                \
+    _LIST_SIMD(reduction(+ : acc))                                             \
+    for (size_t __i = 0; __i < __list_span_n; __i++)                           \
+      acc += (base)[__i] member;                                               \
+  } while (0)
+
+#define _LIST_SPAN_MIN(base, n, member, acc)                                   \
+  do {                                                                         \
+    size_t __list_span_n = (n);                                                \
+    _LIST_SIMD(reduction(min : acc))                                           \
+    for (size_t __i = 0; __i < __list_span_n; __i++)                           \
+      acc = (base)[__i] member < acc ? (base)[__i] member : acc;               \
+  } while (0)
+
+#define _LIST_SPAN_MAX(base, n, member, acc)                                   \
+  do {                                                                         \
+    size_t __list_span_n = (n);                                                \
+    _LIST_SIMD(reduction(max : acc))                                           \
+    for (size_t __i = 0; __i < __list_span_n; __i++)                           \
+      acc = (base)[__i] member > acc ? (base)[__i] member : acc;               \
+  } while (0)
+
+#define _LIST_SPAN_COUNT_IF(base, n, member, var, predicate, count)            \
+  do {                                                                         \
+    size_t __list_span_n = (n);                                                \
+    _LIST_SIMD(reduction(+ : count))                                           \
+    for (size_t __i = 0; __i < __list_span_n; __i++) {                         \
+      typeof((base)[0] member) var = (base)[__i] member;                       \
+      count += (predicate) ? 1 : 0;                                            \
+    }                                                                          \
+  } while (0)
+
+#define _LIST_SPAN_FIND(base, n, member, key, found)                           \
+  do {                                                                         \
+    size_t __list_span_n = (n);                                                \
+    for (size_t __b = 0; !(found) && __b < __list_span_n; __b += 16) {         \
+      size_t __list_span_end = __b + 16 < __list_span_n ? __b + 16             \
+                                                        : __list_span_n;       \
+      int __list_any = 0;                                                      \
+      _LIST_SIMD(reduction(| : __list_any))                                    \
+      for (size_t __i = __b; __i < __list_span_end; __i++)                     \
+        __list_any |= (base)[__i] member == (key);                             \
+      if (__list_any)                                                          \
+        for (size_t __i = __b; !(found); __i++)                                \
+          if ((base)[__i] member == (key))                                     \
+            found = &(base)[__i] member;                                       \
+    }                                                                          \
+  } while (0)
 
 /**
- * Generic list pop
+ * Flat file format
  *
- * For internal use only - see LIST_APPEND and LIST_PREPEND
+ * LIST_SAVE writes a struct list_file_header followed, at offset
+ * _LIST_FILE_HEADER, by the elements as one contiguous array in list order.
+ * The format is meant for checkpoints of plain old data types read back on
+ * the same kind of machine: entries are written as they are in memory, so
+ * pointers inside them are meaningless after a reload and byte order and
+ * padding are not converted.
+ *
+ * magic - _LIST_FILE_MAGIC
+ * version - _LIST_FILE_VERSION of the writer
+ * entry_size - sizeof the list's type
+ * length - number of entries following the header
  */
-#define _LIST_POP(list, sentinal)                                              \
-  ({                                                                           \
-    typeof((list)->sentinal) __list_internal_temp = (list)->sentinal;          \
-    LIST_REMOVE(list, __list_internal_temp);                                   \
-    typeof(__list_internal_temp->entry) __list_internal_retval;                \
-    __list_internal_retval = __list_internal_temp->entry;                      \
-    free(__list_internal_temp);                                                \
-    __list_internal_retval;                                                    \
-  })
+struct list_file_header {
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long entry_size;
+  unsigned long long length;
+};
+
+#define _LIST_FILE_MAGIC 0x5453494cu /* "LIST" read as a little endian word */
+#define _LIST_FILE_VERSION 1u
+
+// Offset of the first entry in a list file, keeps entries aligned in a mapping
+#define _LIST_FILE_HEADER                                                      \
+  ((sizeof(struct list_file_header) + __BIGGEST_ALIGNMENT__ - 1) &             \
+   ~(size_t)(__BIGGEST_ALIGNMENT__ - 1))
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /**
- * List pop from front
+ * Writes all of buf to fd, retrying short writes
  *
- * @return list_type element at head of list
+ * @return 0 on success, -1 with errno set on failure
  *
- * @param list pointer to list_sentinal_type storing list metadata
+ * @param fd file descriptor to write to
+ * @param buf bytes to write
+ * @param size number of bytes in buf
  */
-#define LIST_POPF(list) _LIST_POP(list, head)
+static inline int list_file_write(int fd, const void *buf, size_t size) {
+  while (size) {
+    ssize_t written = write(fd, buf, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf = (const char *)buf + written;
+    size -= written;
+  }
+  return 0;
+}
 
 /**
- * List pop from back
+ * Maps a list file read only and checks its header
  *
- * @return list_type element at tail of list
+ * @return pointer to the mapping, with the entries at offset
+ * _LIST_FILE_HEADER, or NULL with errno set on failure. EINVAL means the file
+ * is not a list file of entry_size sized entries.
  *
- * @param list pointer to list_sentinal_type storing list metadata
+ * @param fd file descriptor of a file written by LIST_SAVE
+ * @param entry_size sizeof the entries the caller expects
+ * @param length set to the number of entries in the file
+ * @param map_size set to the size of the mapping, for munmap
  */
-#define LIST_POPB(list) _LIST_POP(list, tail)
+static inline void *list_file_map(int fd, size_t entry_size, size_t *length,
+                                  size_t *map_size) {
+  struct stat st;
+  if (fstat(fd, &st))
+    return NULL;
+  if ((size_t)st.st_size < _LIST_FILE_HEADER) {
+    errno = EINVAL;
+    return NULL;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return NULL;
+  const struct list_file_header *header = map;
+  if (header->magic != _LIST_FILE_MAGIC ||
+      header->version != _LIST_FILE_VERSION ||
+      header->entry_size != entry_size ||
+      header->length > ((size_t)st.st_size - _LIST_FILE_HEADER) / entry_size) {
+    munmap(map, st.st_size);
+    errno = EINVAL;
+    return NULL;
+  }
+  *length = header->length;
+  *map_size = st.st_size;
+  return map;
+}
+#endif
 
 /**
- * Generic list safe iterator
+ * Epoch based reclamation domain
  *
- * For internal use only - see LIST_FOR_EACH_SAFE and LIST_FOR_EACH_REV_SAFE
+ * Lets writers of a concurrent list (see list_rcu_TYPE) tell when no reader
+ * can still be looking at a node they unlinked. Each reader thread owns one
+ * of readers slots, identified by its index, and marks the slot with the
+ * current epoch while it traverses. Unlinking a node advances the epoch, and
+ * the node can be freed once every busy slot is marked with a later epoch.
+ *
+ * epoch - current epoch, starts at 1 and only grows
+ * readers - number of reader slots
+ * active - epoch each reader entered with, 0 while it is not reading
  */
-#define _LIST_FOR_EACH(list, var, sentinal, direction, callback)               \
-  do {                                                                         \
-    typeof((list)->sentinal) var = (list)->sentinal;                           \
-    while (var) {                                                              \
-      callback;                                                                \
-      var = var->direction;                                                    \
-    }                                                                          \
-  } while (0)
+struct list_epoch {
+  unsigned long epoch;
+  size_t readers;
+  unsigned long *active;
+};
 
 /**
- * List iterator
+ * Initializes a reclamation domain
  *
- * Iterates from head to tail
- * Does not allows deletion of elemnts during iteration
+ * @return 0 on success, -1 if the slots could not be allocated
  *
- * @param list pointer to list_sentinal type
- * @param var name for variable to be used inside callback
- * @param callback code to be run on each iteration
+ * @param e domain to initialize
+ * @param readers number of reader threads that will use the domain
  */
-#define LIST_FOR_EACH(list, var, callback)                                     \
-  _LIST_FOR_EACH(list, var, head, next, callback)
+static inline int list_epoch_init(struct list_epoch *e, size_t readers) {
+  e->epoch = 1;
+  e->readers = readers;
+  e->active = calloc(readers ? readers : 1, sizeof(*e->active));
+  return e->active ? 0 : -1;
+}
 
 /**
- * List reverse iterator
+ * Releases a reclamation domain, once no list uses it anymore
  *
- * Iterates from tail to head
- * Does not allows deletion of elemnts during iteration
+ * @param e domain to destroy
+ */
+static inline void list_epoch_destroy(struct list_epoch *e) {
+  free(e->active);
+  e->active = NULL;
+  e->readers = 0;
+}
+
+/**
+ * Marks reader slot as reading
  *
- * @param list pointer to list_sentinal type
- * @param var name for variable to be used inside callback
- * @param callback code to be run on each iteration
+ * The fence orders the mark before every load of the traversal, pairing with
+ * the one in list_epoch_advance.
+ *
+ * @param e domain of the list about to be read
+ * @param slot index of the calling reader's slot
  */
-#define LIST_FOR_EACH_REV(list, var, callback)                                 \
-  _LIST_FOR_EACH(list, var, tail, prev, callback)
+static inline void list_epoch_enter(struct list_epoch *e, size_t slot) {
+  __atomic_store_n(&e->active[slot],
+                   __atomic_load_n(&e->epoch, __ATOMIC_ACQUIRE),
+                   __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
 
 /**
- * Generic list safe iterator
+ * Marks reader slot as no longer reading
  *
- * For internal use only - see LIST_FOR_EACH_SAFE and LIST_FOR_EACH_REV_SAFE
+ * @param e domain of the list that was read
+ * @param slot index of the calling reader's slot
  */
-#define _LIST_FOR_EACH_SAFE(list, var, temp, sentinal, direction, callback)    \
-  do {                                                                         \
-    typeof((list)->sentinal) var = (list)->sentinal;                           \
-    typeof(var) temp = NULL;                                                   \
-    if (var)                                                                   \
-      temp = var->direction;                                                   \
-    while (var) {                                                              \
-      callback;                                                                \
-      var = temp;                                                              \
-      if (var)                                                                 \
-        temp = var->direction;                                                 \
-    }                                                                          \
-  } while (0)
+static inline void list_epoch_exit(struct list_epoch *e, size_t slot) {
+  __atomic_store_n(&e->active[slot], 0, __ATOMIC_RELEASE);
+}
 
 /**
- * List safe iterator
+ * Starts a new epoch after nodes were unlinked
  *
- * Allows deletion of elemnts during iteration
+ * @return the epoch that ended, readers marked with it or an earlier one may
+ * still see the unlinked nodes
  *
- * @param list pointer to list_sentinal type
- * @param var name for variable to be used inside callback
- * @param temp name for temporary variable - do not modify in callback
- * @param callback code to be run on each iteration
+ * @param e domain of the list that was changed
  */
-#define LIST_FOR_EACH_SAFE(list, var, temp, callback)                          \
-  _LIST_FOR_EACH_SAFE(list, var, temp, head, next, callback)
+static inline unsigned long list_epoch_advance(struct list_epoch *e) {
+  return __atomic_fetch_add(&e->epoch, 1, __ATOMIC_SEQ_CST);
+}
 
 /**
- * List safe reverse iterator
+ * Tells whether nodes unlinked during epoch can be freed
  *
- * Allows deletion of elemnts during iteration
+ * @return 1 if no reader entered at or before epoch is still reading
  *
- * @param list pointer to list_sentinal type
- * @param var name for variable to be used inside callback
- * @param temp name for temporary variable - do not modify in callback
- * @param callback code to be run on each iteration
+ * @param e domain of the list
+ * @param epoch value returned by list_epoch_advance after the unlink
  */
-#define LIST_FOR_EACH_REV_SAFE(list, var, temp, callback)                      \
-  _LIST_FOR_EACH_SAFE(list, var, temp, tail, prev, callback)
+static inline int list_epoch_safe(struct list_epoch *e, unsigned long epoch) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (size_t i = 0; i < e->readers; i++) {
+    unsigned long active = __atomic_load_n(&e->active[i], __ATOMIC_ACQUIRE);
+    if (active && active <= epoch)
+      return 0;
+  }
+  return 1;
+}
 
 /**
- * List destructor
+ * Number of buckets the retired nodes of a list_rcu_TYPE are grouped in
  *
- * @param list pointer to list_sentinal type to be destroyed
+ * For internal use only - see list_rcu_TYPE
  */
-#define LIST_DESTROY(list)                                                     \
-  LIST_FOR_EACH_SAFE(list, __list_internal_var, __list_internal_temp,          \
-                     { LIST_DEL(list, __list_internal_var); });
+#define _LIST_RCU_BUCKETS 3
 
 /**
- * List constructor
+ * List statistics
  *
- * Since this only initializes and returns a element of list_sentinal_T,
- * this is returned on the stack.
+ * Lists of a type included with LIST_STATS defined count what they do in a
+ * struct list_stats, reachable through LIST_GET_STATS. Without LIST_STATS the
+ * sentinal has no stats storage and every counter update compiles to nothing.
  *
- * @param T type of list to create
- * @param d destructor for the list
+ * allocs - calls to the allocator for single nodes and bulk slabs
+ * frees - single nodes and bulk slabs handed back to the allocator
+ * cache_hits - nodes reused from the node cache instead of allocated
+ * inserts - elements added to the list
+ * pops - elements taken with LIST_POPF and LIST_POPB
+ * dels - elements deleted with LIST_DEL
+ * traversals - iterations started with one of the LIST_FOR_EACH iterators
+ * visited - sum of the list lengths when those iterations started
+ * peak_length - largest length the list has reached
+ * on_alloc, on_free - optional hooks called with ctx after every node or slab
+ *   allocation and before every node release counted above
+ *
+ * e.g.
+ *
+ * ```
+ * #define TYPE int
+ * #define LIST_STATS
+ * #include "list.h"
+ * #undef LIST_STATS
+ * #undef TYPE
+ *
+ * struct list_sentinal_int list = new_list(int, NULL);
+ * LIST_GET_STATS(&list)->on_alloc = trace_alloc;
+ * ...
+ * printf("%zu allocations\n", LIST_GET_STATS(&list)->allocs);
+ * ```
  */
-#define new_list(T, d)                                                         \
+struct list_stats {
+  size_t allocs;
+  size_t frees;
+  size_t cache_hits;
+  size_t inserts;
+  size_t pops;
+  size_t dels;
+  size_t traversals;
+  size_t visited;
+  size_t peak_length;
+  void (*on_alloc)(void *ctx, void *ptr, size_t size);
+  void (*on_free)(void *ctx, void *ptr, size_t size);
+  void *ctx;
+};
+
+/**
+ * Returns the statistics of a list
+ *
+ * @return pointer to struct list_stats, NULL if the list's type was not
+ * included with LIST_STATS
+ *
+ * @param list pointer to list_sentinal_type
+ */
+#define LIST_GET_STATS(list)                                                   \
+  (sizeof((list)->stats) ? (list)->stats : (struct list_stats *)NULL)
+
+/**
+ * Adds n to a statistics counter
+ *
+ * For internal use only - compiles to nothing without LIST_STATS
+ */
+#define _LIST_STAT(list, counter, n)                                           \
   ({                                                                           \
-    struct list_sentinal_##T __new_list_data = {0};                            \
+    if (sizeof((list)->stats))                                                 \
+      (list)->stats->counter += (n);                                           \
+  })
+
+/**
+ * Raises the peak length statistic to length
+ *
+ * For internal use only - compiles to nothing without LIST_STATS
+ */
+#define _LIST_STAT_PEAK(list, length)                                          \
+  ({                                                                           \
+    if (sizeof((list)->stats) && (list)->stats->peak_length < (length))        \
+      (list)->stats->peak_length = (length);                                   \
+  })
+
+/**
+ * Counts an allocator call and runs the hook for it
+ *
+ * For internal use only - counter is allocs or frees, hook on_alloc or
+ * on_free. Compiles to nothing without LIST_STATS
+ */
+#define _LIST_STAT_HOOK(list, counter, hook, ptr, size)                        \
+  ({                                                                           \
+    if (sizeof((list)->stats)) {                                               \
+      (list)->stats->counter++;                                                \
+      if ((list)->stats->hook)                                                 \
+        (list)->stats->hook((list)->stats->ctx, ptr, size);                    \
+    }                                                                          \
+  })
+
+/**
+ * Memory footprint of a container
+ *
+ * Filled in by LIST_MEMORY_USAGE, LIST_CHUNK_MEMORY_USAGE and
+ * DEQUE_MEMORY_USAGE. The struct doesn't depend on the element type, so the
+ * footprints of lists of every type can be summed with list_memory_add.
+ *
+ * payload - bytes taken by the elements themselves
+ * links - bytes taken by node links and padding, and by the sentinal
+ * allocator - estimated bookkeeping of the allocator behind those bytes
+ * slack - bytes held but not storing an element: unused inline slots, cached
+ *   nodes, freed nodes of bulk slabs and free room in chunks and deques
+ */
+struct list_memory {
+  size_t payload;
+  size_t links;
+  size_t allocator;
+  size_t slack;
+};
+
+/**
+ * Estimates the bookkeeping the allocator adds to an allocation of size bytes
+ *
+ * Blocks from malloc are modelled on glibc: a size_t header, rounded up to
+ * twice the size of a size_t, and at least four size_ts. Blocks from
+ * allocators with a block_size, such as pools, cost that size. Other
+ * allocators are assumed to add nothing.
+ *
+ * @return estimated bytes on top of size
+ *
+ * @param allocator allocator the block came from, NULL for malloc
+ * @param size requested size of the block
+ */
+static inline size_t list_allocator_overhead(struct list_allocator *allocator,
+                                             size_t size) {
+  if (allocator) {
+    if (!allocator->block_size)
+      return 0;
+    if (size <= allocator->block_size)
+      return allocator->block_size - size;
+  }
+  size_t align = 2 * sizeof(size_t) - 1;
+  size_t block = (size + sizeof(size_t) + align) & ~align;
+  if (block < 4 * sizeof(size_t))
+    block = 4 * sizeof(size_t);
+  return block - size;
+}
+
+/**
+ * Adds the footprint of one container to a running total
+ *
+ * e.g.
+ *
+ * ```
+ * struct list_memory total = {0};
+ * list_memory_add(&total, LIST_MEMORY_USAGE(&ints));
+ * list_memory_add(&total, DEQUE_MEMORY_USAGE(&records));
+ * ```
+ *
+ * @param total footprint to add to
+ * @param usage footprint of the container
+ */
+static inline void list_memory_add(struct list_memory *total,
+                                   struct list_memory usage) {
+  total->payload += usage.payload;
+  total->links += usage.links;
+  total->allocator += usage.allocator;
+  total->slack += usage.slack;
+}
+
+/**
+ * Total bytes of a footprint
+ *
+ * @return sum of every field of usage
+ *
+ * @param usage footprint to sum
+ */
+static inline size_t list_memory_total(struct list_memory usage) {
+  return usage.payload + usage.links + usage.allocator + usage.slack;
+}
+
+/**
+ * Intrusive list
+ *
+ * Instead of copying elements into nodes allocated by the list, callers embed
+ * a struct list_link in their own objects and link the objects themselves.
+ * Nothing is allocated or copied, removal is O(1) and an object can sit on
+ * several lists at once by embedding one link per list.
+ *
+ * e.g.
+ *
+ * ```
+ * struct conn {
+ *   int fd;
+ *   struct list_link all;
+ *   struct list_link idle;
+ * };
+ *
+ * struct list_intrusive conns = new_intrusive_list();
+ * LIST_INTRUSIVE_APPEND(&conns, c, all);
+ * LIST_INTRUSIVE_FOR_EACH(&conns, conn, struct conn, all, {
+ *   printf("%d\n", conn->fd);
+ * });
+ * LIST_INTRUSIVE_REMOVE(&conns, c, all);
+ * ```
+ */
+struct list_link {
+  struct list_link *next;
+  struct list_link *prev;
+};
+
+struct list_intrusive {
+  struct list_link *head;
+  struct list_link *tail;
+  size_t length;
+  struct list_link *finger; /* Link last returned by LIST_AT */
+  size_t finger_index;
+};
+
+/**
+ * Converts a pointer to a member back into a pointer to its enclosing object
+ *
+ * @param ptr pointer to the member
+ * @param type type of the enclosing object
+ * @param member name of the member inside type
+ */
+#define LIST_CONTAINER_OF(ptr, type, member)                                   \
+  ((type *)((char *)(ptr) - __builtin_offsetof(type, member)))
+
+/**
+ * Intrusive list constructor
+ */
+#define new_intrusive_list() ((struct list_intrusive){0})
+
+/**
+ * Append an object to the tail of an intrusive list
+ *
+ * @return size_t length of new list
+ *
+ * @param list pointer to struct list_intrusive
+ * @param obj pointer to the object to append
+ * @param member name of the struct list_link inside obj to link through
+ */
+#define LIST_INTRUSIVE_APPEND(list, obj, member)                               \
+  _LIST_LINK(list, &(obj)->member, tail, head, next, prev)
+
+/**
+ * Prepend an object to the head of an intrusive list
+ *
+ * @return size_t length of new list
+ *
+ * @param list pointer to struct list_intrusive
+ * @param obj pointer to the object to prepend
+ * @param member name of the struct list_link inside obj to link through
+ */
+#define LIST_INTRUSIVE_PREPEND(list, obj, member)                              \
+  _LIST_LINK(list, &(obj)->member, head, tail, prev, next)
+
+/**
+ * Removes an object from an intrusive list
+ *
+ * The object itself is left untouched apart from its link.
+ *
+ * @param list pointer to struct list_intrusive
+ * @param obj pointer to the object to remove
+ * @param member name of the struct list_link inside obj it is linked through
+ */
+#define LIST_INTRUSIVE_REMOVE(list, obj, member)                               \
+  LIST_REMOVE(list, &(obj)->member)
+
+/**
+ * Intrusive list iterator
+ *
+ * Iterates from head to tail
+ * Does not allows removal of objects during iteration
+ *
+ * @param list pointer to struct list_intrusive
+ * @param var name for the object pointer to be used inside callback
+ * @param type type of the linked objects
+ * @param member name of the struct list_link inside type
+ * @param callback code to be run on each iteration
+ */
+#define LIST_INTRUSIVE_FOR_EACH(list, var, type, member, callback)             \
+  do {                                                                         \
+    struct list_link *__list_link = (list)->head;                              \
+    while (__list_link) {                                                      \
+      type *var = LIST_CONTAINER_OF(__list_link, type, member);                \
+      callback;                                                                \
+      __list_link = __list_link->next;                                         \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Intrusive list safe iterator
+ *
+ * Allows removal of the current object during iteration
+ *
+ * @param list pointer to struct list_intrusive
+ * @param var name for the object pointer to be used inside callback
+ * @param type type of the linked objects
+ * @param member name of the struct list_link inside type
+ * @param callback code to be run on each iteration
+ */
+#define LIST_INTRUSIVE_FOR_EACH_SAFE(list, var, type, member, callback)        \
+  do {                                                                         \
+    struct list_link *__list_link = (list)->head;                              \
+    while (__list_link) {                                                      \
+      struct list_link *__list_link_next = __list_link->next;                  \
+      type *var = LIST_CONTAINER_OF(__list_link, type, member);                \
+      callback;                                                                \
+      __list_link = __list_link_next;                                          \
+    }                                                                          \
+  } while (0)
+#endif
+
+#ifndef _LIST_IMPLEMENTATION
+/**
+ * Defines parametrized list type
+ *
+ * @param T type parameter for list
+ */
+#define LIST_DEFN(T)                                                           \
+  struct list_##T {                                                            \
+    struct list_##T *next;                                                     \
+    struct list_##T *prev;                                                     \
+    struct list_slab *slab; /* Bulk slab holding the node, or NULL */          \
+    T entry;                /* Variable length struct */                       \
+  };
+EXPAND(LIST_DEFN, TYPE)
+#undef LIST_DEFN
+
+/**
+ * Define destructor type
+ *
+ * @param T type parameter for list
+ */
+#define LIST_DESTRUCTOR(T) typedef void (*list_destructor_##T)(T);
+EXPAND(LIST_DESTRUCTOR, TYPE)
+#undef LIST_DESTRUCTOR
+
+/**
+ * Inline nodes
+ *
+ * With LIST_INLINE_CAPACITY set to N, every list_sentinal_TYPE carries N node
+ * slots of its own. Inserts use a free slot before asking the allocator, so a
+ * list that never holds more than N elements does not allocate at all, which
+ * suits short lived lists kept on the stack. Nodes are still released to the
+ * node cache first when it is enabled.
+ *
+ * Since nodes then point into the sentinal, a list holding elements must not
+ * be copied or moved in memory (e.g. returned by value or memcpy'd). Copying
+ * an empty list, as new_list does, is fine. Elements in inline slots are moved
+ * to allocated nodes when they leave the list through LIST_SPLICE or
+ * LIST_SPLIT, which invalidates pointers to those nodes.
+ */
+#ifdef LIST_INLINE_CAPACITY
+#define _LIST_INLINE_N LIST_INLINE_CAPACITY
+#else
+#define _LIST_INLINE_N 0
+#endif
+
+#ifdef LIST_STATS
+#define _LIST_STATS_N 1
+#else
+#define _LIST_STATS_N 0
+#endif
+
+/**
+ * Trivial types
+ *
+ * Defining TYPE_TRIVIAL next to TYPE replaces the destructor field of
+ * list_sentinal_TYPE by a zero length array. Every destructor check in the
+ * list macros is then false at compile time, so deleting, popping, filtering
+ * and destroying compile down to unlinking and freeing, with no branch or
+ * indirect call per node. Pass NULL as the destructor to the constructors,
+ * anything else is a compile error; the chunked list and the deque are not
+ * affected.
+ */
+#ifdef TYPE_TRIVIAL
+#define _LIST_DESTRUCTOR_FIELD(T) list_destructor_##T destructor[0];
+#else
+#define _LIST_DESTRUCTOR_FIELD(T) list_destructor_##T destructor;
+#endif
+
+/**
+ * Define list metadata container struct
+ *
+ * @param T type parameter for list
+ * @param N number of inline node slots
+ */
+#define LIST_SENTINALS(T, N)                                                   \
+  struct list_sentinal_##T {                                                   \
+    struct list_##T *head;                                                     \
+    struct list_##T *tail;                                                     \
+    size_t length;                                                             \
+    _LIST_DESTRUCTOR_FIELD(T)                                                  \
+    struct list_allocator *allocator; /* NULL to use malloc/free */            \
+    int bulk; /* Nonzero if nodes may live in bulk slabs */                    \
+    struct list_##T *cache;           /* Released nodes kept for reuse */      \
+    size_t cache_length;                                                       \
+    size_t cache_capacity; /* 0 disables the cache */                          \
+    struct list_##T *finger; /* Node last returned by LIST_AT */               \
+    size_t finger_index;                                                       \
+    unsigned char inline_used[N]; /* Nonzero for slots holding a node */       \
+    struct list_##T inline_nodes[N];                                           \
+    struct list_stats stats[_LIST_STATS_N]; /* See LIST_GET_STATS */           \
+  };
+EXPAND1(LIST_SENTINALS, TYPE, _LIST_INLINE_N)
+#undef LIST_SENTINALS
+#undef _LIST_INLINE_N
+#undef _LIST_STATS_N
+#undef _LIST_DESTRUCTOR_FIELD
+
+/**
+ * Returns the destructor of list
+ *
+ * For internal use only - NULL at compile time for TYPE_TRIVIAL lists
+ */
+#define _LIST_GET_DESTRUCTOR(list)                                             \
+  (sizeof((list)->destructor)                                                  \
+       ? *(void (**)(typeof((list)->head->entry)))&(list)->destructor          \
+       : NULL)
+
+/**
+ * Fails to compile unless list can take d as its destructor
+ *
+ * For internal use only - TYPE_TRIVIAL lists have no destructor to set, so
+ * for them d must be NULL at compile time
+ */
+#define _LIST_CHECK_DESTRUCTOR(list, d)                                        \
+  _Static_assert(                                                              \
+      __builtin_choose_expr(sizeof((list)->destructor), 1,                     \
+                            __builtin_constant_p((__UINTPTR_TYPE__)(d)) &&     \
+                                !(__UINTPTR_TYPE__)(d)),                       \
+      "TYPE_TRIVIAL lists take no destructor")
+
+/**
+ * Sets the destructor of list without checking it
+ *
+ * For internal use only - for generated functions, whose d is a parameter that
+ * their macro wrapper has already checked. Does nothing for TYPE_TRIVIAL lists.
+ */
+#define _LIST_STORE_DESTRUCTOR(list, d)                                        \
+  ({                                                                           \
+    if (sizeof((list)->destructor))                                            \
+      *(void (**)(typeof((list)->head->entry)))&(list)->destructor = (d);      \
+  })
+
+/**
+ * Sets the destructor of list
+ *
+ * For internal use only - see _LIST_CHECK_DESTRUCTOR
+ */
+#define _LIST_SET_DESTRUCTOR(list, d)                                          \
+  ({                                                                           \
+    _LIST_CHECK_DESTRUCTOR(list, d);                                           \
+    _LIST_STORE_DESTRUCTOR(list, d);                                           \
+  })
+
+/**
+ * Calls the destructor of list on entry if there is one
+ *
+ * For internal use only - compiles to nothing for TYPE_TRIVIAL lists
+ */
+#define _LIST_DESTRUCT(list, entry)                                            \
+  ({                                                                           \
+    if (_LIST_GET_DESTRUCTOR(list))                                            \
+      _LIST_GET_DESTRUCTOR(list)(entry);                                       \
+  })
+
+/**
+ * Number of inline node slots of a list, see "Inline nodes"
+ *
+ * @param list pointer to list_sentinal_type
+ */
+#define LIST_INLINE_SLOTS(list)                                                \
+  (sizeof((list)->inline_nodes) / sizeof(*(list)->inline_nodes))
+
+/**
+ * Tells whether node lives in one of the inline slots of list
+ *
+ * For internal use only
+ */
+#define _LIST_INLINE_OWNS(list, node)                                          \
+  ((char *)(node) >= (char *)(list)->inline_nodes &&                           \
+   (char *)(node) < (char *)(list)->inline_nodes + sizeof((list)->inline_nodes))
+
+/**
+ * Moves every element in an inline slot, starting at from, to a new node
+ *
+ * For internal use only - see LIST_SPLICE_AT and LIST_SPLIT. Compiles to
+ * nothing for lists without inline slots.
+ */
+#define _LIST_INLINE_EVICT(list, from)                                         \
+  _LIST_INLINE_EVICT_N(list, from, next, (size_t)-1)
+
+/**
+ * Moves elements in an inline slot to a new node, checking n nodes from from
+ *
+ * For internal use only - see _LIST_INLINE_EVICT. step is next or prev.
+ */
+#define _LIST_INLINE_EVICT_N(list, from, step, n)                              \
+  ({                                                                           \
+    if (LIST_INLINE_SLOTS(list)) {                                             \
+      size_t __list_left = (n);                                                \
+      for (typeof((list)->head) __list_in = (from); __list_in && __list_left;  \
+           __list_in = __list_in->step, __list_left--) {                       \
+        if (!_LIST_INLINE_OWNS(list, __list_in))                               \
+          continue;                                                            \
+        typeof(__list_in) __list_out = _LIST_ALLOC(list, sizeof(*__list_out)); \
+        _LIST_STAT_HOOK(list, allocs, on_alloc, __list_out,                    \
+                        sizeof(*__list_out));                                  \
+        *__list_out = *__list_in;                                              \
+        if (__list_out->prev)                                                  \
+          __list_out->prev->next = __list_out;                                 \
+        else                                                                   \
+          (list)->head = __list_out;                                           \
+        if (__list_out->next)                                                  \
+          __list_out->next->prev = __list_out;                                 \
+        else                                                                   \
+          (list)->tail = __list_out;                                           \
+        if ((list)->finger == __list_in)                                       \
+          (list)->finger = __list_out;                                         \
+        (list)->inline_used[__list_in - (list)->inline_nodes] = 0;             \
+        __list_in = __list_out;                                                \
+      }                                                                        \
+    }                                                                          \
+  })
+
+/**
+ * Allocates an uninitialized node for list
+ *
+ * For internal use only - see _LIST_ADD
+ */
+#define _LIST_NODE_NEW(list)                                                   \
+  ({                                                                           \
+    typeof((list)->head) __list_node = (list)->cache;                          \
+    if (__list_node) {                                                         \
+      (list)->cache = __list_node->next;                                       \
+      (list)->cache_length--;                                                  \
+      _LIST_STAT(list, cache_hits, 1);                                         \
+    } else {                                                                   \
+      for (size_t __i = 0; __i != LIST_INLINE_SLOTS(list); __i++)              \
+        if (!(list)->inline_used[__i]) {                                       \
+          (list)->inline_used[__i] = 1;                                        \
+          __list_node = &(list)->inline_nodes[__i];                            \
+          break;                                                               \
+        }                                                                      \
+      if (!__list_node) {                                                      \
+        __list_node = _LIST_ALLOC(list, sizeof(*__list_node));                 \
+        _LIST_STAT_HOOK(list, allocs, on_alloc, __list_node,                   \
+                        sizeof(*__list_node));                                 \
+      }                                                                        \
+      __list_node->slab = NULL;                                                \
+    }                                                                          \
+    _LIST_STAT(list, inserts, 1);                                              \
+    _LIST_STAT_PEAK(list, (list)->length + 1);                                 \
+    __list_node;                                                               \
+  })
+
+/**
+ * Returns a node to its bulk slab
+ *
+ * For internal use only - see _LIST_NODE_RELEASE. If this is the slab's last
+ * node, its release is counted and hooked with the same pointer and size as
+ * its allocation.
+ */
+#define _LIST_SLAB_RELEASE(list, slab)                                         \
+  ({                                                                           \
+    struct list_slab *__list_slab = (slab);                                    \
+    if (__list_slab->live == 1)                                                \
+      _LIST_STAT_HOOK(list, frees, on_free, _LIST_SLAB_NODES(__list_slab),     \
+                      __list_slab->bytes - _LIST_SLAB_HEADER);                 \
+    list_slab_put(__list_slab);                                                \
+  })
+
+/**
+ * Returns a node to its slab or allocator, bypassing the node cache
+ *
+ * For internal use only - see LIST_NODE_FREE
+ */
+#define _LIST_NODE_RELEASE(list, elem)                                         \
+  ({                                                                           \
+    if (_LIST_INLINE_OWNS(list, elem))                                         \
+      (list)->inline_used[(elem) - (list)->inline_nodes] = 0;                  \
+    else if ((elem)->slab)                                                     \
+      _LIST_SLAB_RELEASE(list, (elem)->slab);                                  \
+    else {                                                                     \
+      _LIST_STAT_HOOK(list, frees, on_free, elem, sizeof(*(elem)));            \
+      _LIST_FREE(list, elem, sizeof(*(elem)));                                 \
+    }                                                                          \
+  })
+
+/**
+ * Releases a node that is no longer linked into list
+ *
+ * Use this instead of free for nodes detached with LIST_REMOVE, since the
+ * node may belong to the list's allocator. The destructor is not called.
+ * The node is kept in the list's node cache if it has room.
+ *
+ * @param list pointer to list_sentinal_type the node was allocated by
+ * @param elem pointer to list_type of node to release
+ */
+#define LIST_NODE_FREE(list, elem)                                             \
+  ({                                                                           \
+    typeof((list)->head) __list_freed = (elem);                                \
+    if ((list)->cache_length < (list)->cache_capacity) {                       \
+      __list_freed->next = (list)->cache;                                      \
+      (list)->cache = __list_freed;                                            \
+      (list)->cache_length++;                                                  \
+    } else                                                                     \
+      _LIST_NODE_RELEASE(list, __list_freed);                                  \
+  })
+
+/**
+ * Sets the size of the list's node cache
+ *
+ * Nodes freed by LIST_DEL, LIST_POPF, LIST_POPB and LIST_NODE_FREE are kept
+ * in the cache, up to capacity nodes, and handed out again by the next
+ * inserts instead of going back to the allocator. A capacity of 0 (the
+ * default) disables the cache. Cached nodes beyond the new capacity are
+ * released.
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param capacity maximum number of cached nodes
+ */
+#define LIST_SET_CACHE_CAPACITY(list, capacity)                                \
+  ({                                                                           \
+    (list)->cache_capacity = (capacity);                                       \
+    while ((list)->cache_length > (list)->cache_capacity) {                    \
+      typeof((list)->head) __list_cached = (list)->cache;                      \
+      (list)->cache = __list_cached->next;                                     \
+      (list)->cache_length--;                                                  \
+      _LIST_NODE_RELEASE(list, __list_cached);                                 \
+    }                                                                          \
+  })
+
+/**
+ * Releases every node in the list's node cache
+ *
+ * The cache capacity is unchanged, so the cache refills as nodes are freed.
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ */
+#define LIST_SHRINK(list)                                                      \
+  ({                                                                           \
+    size_t __list_capacity = (list)->cache_capacity;                           \
+    LIST_SET_CACHE_CAPACITY(list, 0);                                          \
+    (list)->cache_capacity = __list_capacity;                                  \
+  })
+
+/**
+ * Generic list link
+ *
+ * For internal use only - links an unlinked node in at the top end of list
+ */
+#define _LIST_LINK(list, node, top, bottom, direction, reverse)                \
+  ({                                                                           \
+    typeof((list)->head) __list_link_node = (node);                            \
+    __list_link_node->next = NULL;                                             \
+    __list_link_node->prev = NULL;                                             \
+    if (!(list)->bottom)                                                       \
+      (list)->bottom = __list_link_node;                                       \
+    if (!(list)->top)                                                          \
+      (list)->top = __list_link_node;                                          \
+    else {                                                                     \
+      (list)->top->direction = __list_link_node;                               \
+      __list_link_node->reverse = (list)->top;                                 \
+      (list)->top = __list_link_node;                                          \
+    }                                                                          \
+    /* A new head shifts every position by one */                              \
+    if ((list)->finger && (list)->head == __list_link_node)                    \
+      (list)->finger_index++;                                                  \
+    ++(list)->length;                                                          \
+  })
+
+/**
+ * Generic list add
+ *
+ * For internal use only - see LIST_APPEND and LIST_PREPEND
+ */
+#define _LIST_ADD(list, elem, top, bottom, direction, reverse)                 \
+  ({                                                                           \
+    typeof(*((list)->head)) *new_entry = _LIST_NODE_NEW(list);                 \
+    new_entry->entry = elem;                                                   \
+    _LIST_LINK(list, new_entry, top, bottom, direction, reverse);              \
+  })
+
+/**
+ * Append an element to the tail of the list
+ *
+ * @return size_t length of new list
+ *
+ * @param list list_sentinal_type storing list metadata
+ * @param elem element of the same type as the list to append (not of type
+ *list_type)
+ *
+ * e.g.
+ *
+ * struct list_sentinal_int my_list = new_list_int(NULL, 0, NULL);
+ * LIST_APPPEND(&my_list, 5);
+ **
+ */
+#define LIST_APPEND(list, elem) _LIST_ADD(list, elem, tail, head, next, prev)
+
+/**
+ * Prepend an element to the head of the list
+ *
+ * @return size_t length of new list
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param elem element of the same type as the list to prepend (not of type
+ * list_type)
+ *
+ * e.g.
+ *
+ * struct list_sentinal_int my_list = new_list_int(NULL, 0, NULL);
+ * LIST_PREPEND(&my_list, 5);
+ *
+ */
+#define LIST_PREPEND(list, elem) _LIST_ADD(list, elem, head, tail, prev, next)
+
+/**
+ * Generic bulk list add
+ *
+ * For internal use only - see LIST_APPEND_ARRAY and LIST_PREPEND_ARRAY
+ *
+ * Allocates all len nodes in a single slab, laid out in list order, and
+ * splices the resulting chain onto the list once.
+ */
+#define _LIST_ADD_ARRAY(list, array, len, first, last, top, bottom, direction, \
+                        reverse)                                               \
+  ({                                                                           \
+    size_t __list_len = (len);                                                 \
+    struct list_slab *__list_slab =                                            \
+        __list_len                                                             \
+            ? list_slab_new((list)->allocator, sizeof(*(list)->head),          \
+                            __list_len)                                        \
+            : NULL;                                                            \
+    if (__list_slab) {                                                         \
+      typeof((list)->head) __list_nodes = _LIST_SLAB_NODES(__list_slab);       \
+      for (size_t __i = 0; __i < __list_len; __i++) {                          \
+        __list_nodes[__i].next = &__list_nodes[__i] + 1;                       \
+        __list_nodes[__i].prev = __i ? &__list_nodes[__i - 1] : NULL;          \
+        __list_nodes[__i].slab = __list_slab;                                  \
+        __list_nodes[__i].entry = (array)[first];                              \
+      }                                                                        \
+      __list_nodes[__list_len - 1].next = NULL;                                \
+      __list_nodes[last].reverse = (list)->top;                                \
+      if ((list)->top)                                                         \
+        (list)->top->direction = &__list_nodes[last];                          \
+      else                                                                     \
+        (list)->bottom = &__list_nodes[last];                                  \
+      (list)->top = &__list_nodes[__list_len - 1 - (last)];                    \
+      (list)->length += __list_len;                                            \
+      (list)->finger = NULL;                                                   \
+      (list)->bulk = 1;                                                        \
+      _LIST_STAT_HOOK(list, allocs, on_alloc, __list_nodes,                    \
+                      __list_len * sizeof(*__list_nodes));                     \
+      _LIST_STAT(list, inserts, __list_len);                                   \
+      _LIST_STAT_PEAK(list, (list)->length);                                   \
+    }                                                                          \
+    list;                                                                      \
+  })
+
+/**
+ * Generic in place list add
+ *
+ * For internal use only - see LIST_EMPLACE_APPEND and LIST_EMPLACE_PREPEND
+ */
+#define _LIST_EMPLACE(list, top, bottom, direction, reverse)                   \
+  ({                                                                           \
+    typeof(*((list)->head)) *new_entry = _LIST_NODE_NEW(list);                 \
+    _LIST_LINK(list, new_entry, top, bottom, direction, reverse);              \
+    &new_entry->entry;                                                         \
+  })
+
+/**
+ * Append an uninitialized element to the tail of the list
+ *
+ * The element is constructed directly in the node through the returned
+ * pointer instead of being copied in, which avoids a copy of large types.
+ *
+ * @return pointer to the entry of the new node
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ *
+ * e.g.
+ *
+ * struct record *r = LIST_EMPLACE_APPEND(&my_list);
+ * r->id = 5;
+ */
+#define LIST_EMPLACE_APPEND(list) _LIST_EMPLACE(list, tail, head, next, prev)
+
+/**
+ * Prepend an uninitialized element to the head of the list
+ *
+ * See LIST_EMPLACE_APPEND
+ *
+ * @return pointer to the entry of the new node
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ */
+#define LIST_EMPLACE_PREPEND(list) _LIST_EMPLACE(list, head, tail, prev, next)
+
+/**
+ * Append an array to a list.
+ *
+ * All nodes are allocated in one slab, in list order. The slab is released
+ * once every node in it has been deleted.
+ *
+ * @return pointer to the list passed in
+ *
+ * @param list pointer list to append array to
+ * @param array elements to append to list
+ * @param len length of array
+ */
+#define LIST_APPEND_ARRAY(list, array, len)                                    \
+  _LIST_ADD_ARRAY(list, array, len, __i, 0, tail, head, next, prev)
+
+/**
+ * Prepend an array to a list.
+ *
+ * Equivalent to prepending each element in turn, so the last element of
+ * array ends up at the head. All nodes are allocated in one slab, in list
+ * order. The slab is released once every node in it has been deleted.
+ *
+ * @return pointer to the list passed in
+ *
+ * @param list pointer list to prepend array to
+ * @param array elements to prepend to list
+ * @param len length of array
+ */
+#define LIST_PREPEND_ARRAY(list, array, len)                                   \
+  _LIST_ADD_ARRAY(list, array, len, __list_len - 1 - __i, __list_len - 1,      \
+                  head, tail, prev, next)
+
+/**
+ * Deletes an element from the list
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param elem pointer to list_type of element to delete
+ */
+#define LIST_DEL(list, elem)                                                   \
+  ({                                                                           \
+    LIST_REMOVE(list, elem);                                                   \
+    _LIST_DESTRUCT(list, (elem)->entry);                                       \
+    LIST_NODE_FREE(list, elem);                                                \
+    _LIST_STAT(list, dels, 1);                                                 \
+  })
+
+/**
+ * Removes an element from a list without deleteing it
+ *
+ * @return size_t new length of list
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param elem pointer to list_type of element to remove
+ */
+#define LIST_REMOVE(list, elem)                                                \
+  ({                                                                           \
+    if ((elem)->prev)                                                          \
+      (elem)->prev->next = (elem)->next;                                       \
+    if ((elem)->next)                                                          \
+      (elem)->next->prev = (elem)->prev;                                       \
+    if ((elem) == (list)->head)                                                \
+      (list)->head = (list)->head->next;                                       \
+    if ((elem) == (list)->tail)                                                \
+      (list)->tail = (list)->tail->prev;                                       \
+    (list)->finger = NULL;                                                     \
+    (list)->length--;                                                          \
+  })
+
+/**
+ * Moves all elements of src to the tail of dst
+ *
+ * No nodes are allocated or freed, so this is O(1). Both lists must use the
+ * same allocator.
+ *
+ * @return size_t new length of dst
+ *
+ * @param dst pointer to list_sentinal_type to append to
+ * @param src pointer to list_sentinal_type to take elements from, left empty
+ */
+#define LIST_SPLICE(dst, src) LIST_SPLICE_AT(dst, NULL, src)
+
+/**
+ * Moves all elements of src into dst before pos
+ *
+ * No nodes are allocated or freed. Both lists must use the same allocator.
+ *
+ * @return size_t new length of dst
+ *
+ * @param dst pointer to list_sentinal_type to insert into
+ * @param pos pointer to list_type in dst to insert before, NULL for the tail
+ * @param src pointer to list_sentinal_type to take elements from, left empty
+ */
+#define LIST_SPLICE_AT(dst, pos, src)                                          \
+  ({                                                                           \
+    typeof((dst)->head) __list_pos = (pos);                                    \
+    _LIST_INLINE_EVICT(src, (src)->head);                                      \
+    if ((src)->head) {                                                         \
+      typeof((dst)->head) __list_before =                                      \
+          __list_pos ? __list_pos->prev : (dst)->tail;                         \
+      (src)->head->prev = __list_before;                                       \
+      if (__list_before)                                                       \
+        __list_before->next = (src)->head;                                     \
+      else                                                                     \
+        (dst)->head = (src)->head;                                             \
+      (src)->tail->next = __list_pos;                                          \
+      if (__list_pos)                                                          \
+        __list_pos->prev = (src)->tail;                                        \
+      else                                                                     \
+        (dst)->tail = (src)->tail;                                             \
+      (dst)->length += (src)->length;                                          \
+      _LIST_STAT_PEAK(dst, (dst)->length);                                     \
+      (dst)->finger = NULL;                                                    \
+      (dst)->bulk |= (src)->bulk;                                              \
+      (src)->head = (src)->tail = NULL;                                        \
+      (src)->length = 0;                                                       \
+      (src)->finger = NULL;                                                    \
+    }                                                                          \
+    (dst)->length;                                                             \
+  })
+
+/**
+ * Cuts list in two at node
+ *
+ * node and every element after it are moved to the tail of out. Finding the
+ * new lengths walks from node towards whichever end of list is closer.
+ * Both lists must use the same allocator.
+ *
+ * @return size_t number of elements moved to out
+ *
+ * @param list pointer to list_sentinal_type to cut
+ * @param node pointer to list_type in list of the first element to move
+ * @param out pointer to list_sentinal_type receiving the elements
+ */
+#define LIST_SPLIT(list, node, out)                                            \
+  ({                                                                           \
+    typeof((list)->head) __list_cut = (node);                                  \
+    typeof(__list_cut) __list_keep = __list_cut->prev;                         \
+    _LIST_INLINE_EVICT(list, __list_cut);                                      \
+    __list_cut = __list_keep ? __list_keep->next : (list)->head;               \
+    typeof(__list_cut) __list_fwd = __list_cut;                                \
+    typeof(__list_cut) __list_back = __list_cut->prev;                         \
+    size_t __list_steps = 0;                                                   \
+    while (__list_fwd && __list_back) {                                        \
+      __list_fwd = __list_fwd->next;                                           \
+      __list_back = __list_back->prev;                                         \
+      __list_steps++;                                                          \
+    }                                                                          \
+    size_t __list_moved =                                                      \
+        __list_fwd ? (list)->length - __list_steps : __list_steps;             \
+    typeof(*(list)) __list_rest = {0};                                         \
+    __list_rest.head = __list_cut;                                             \
+    __list_rest.tail = (list)->tail;                                           \
+    __list_rest.length = __list_moved;                                         \
+    __list_rest.bulk = (list)->bulk;                                           \
+    (list)->tail = __list_cut->prev;                                           \
+    if ((list)->tail)                                                          \
+      (list)->tail->next = NULL;                                               \
+    else                                                                       \
+      (list)->head = NULL;                                                     \
+    __list_cut->prev = NULL;                                                   \
+    (list)->length -= __list_moved;                                            \
+    (list)->finger = NULL;                                                     \
+    LIST_SPLICE(out, &__list_rest);                                            \
+    __list_moved;                                                              \
+  })
+
+/**
+ * Sorts a list in place
+ *
+ * Stable, iterative bottom-up merge sort. Nodes are relinked rather than
+ * copied, so no memory is allocated and pointers to nodes stay valid.
+ *
+ * @return pointer to the list passed in
+ *
+ * @param list pointer to list_sentinal_type to sort
+ * @param cmp function or function-like macro called as cmp(a, b) with two
+ * entries of the list, returning a negative value, zero or a positive value
+ * when a sorts before, equal to or after b. Passing a macro lets the
+ * comparison be inlined.
+ *
+ * e.g.
+ *
+ * #define INT_CMP(a, b) ((a) - (b))
+ * LIST_SORT(&my_list, INT_CMP);
+ */
+#define LIST_SORT(list, cmp)                                                   \
+  ({                                                                           \
+    typeof((list)->head) __list_in = (list)->head;                             \
+    size_t __list_run = 1;                                                     \
+    while (__list_in) {                                                        \
+      typeof(__list_in) __list_p = __list_in;                                  \
+      typeof(__list_in) __list_last = NULL;                                    \
+      size_t __list_merges = 0;                                                \
+      __list_in = NULL;                                                        \
+      /* Merge each pair of runs of length __list_run */                       \
+      while (__list_p) {                                                       \
+        typeof(__list_p) __list_q = __list_p;                                  \
+        size_t __list_psize = 0;                                               \
+        size_t __list_qsize = __list_run;                                      \
+        __list_merges++;                                                       \
+        while (__list_q && __list_psize < __list_run) {                        \
+          __list_q = __list_q->next;                                           \
+          __list_psize++;                                                      \
+        }                                                                      \
+        while (__list_psize || (__list_qsize && __list_q)) {                   \
+          typeof(__list_p) __list_take;                                        \
+          if (__list_psize &&                                                  \
+              (!__list_qsize || !__list_q ||                                   \
+               cmp(__list_p->entry, __list_q->entry) <= 0)) {                  \
+            __list_take = __list_p;                                            \
+            __list_p = __list_p->next;                                         \
+            __list_psize--;                                                    \
+          } else {                                                             \
+            __list_take = __list_q;                                            \
+            __list_q = __list_q->next;                                         \
+            __list_qsize--;                                                    \
+          }                                                                    \
+          if (__list_last)                                                     \
+            __list_last->next = __list_take;                                   \
+          else                                                                 \
+            __list_in = __list_take;                                           \
+          __list_take->prev = __list_last;                                     \
+          __list_last = __list_take;                                           \
+        }                                                                      \
+        __list_p = __list_q;                                                   \
+      }                                                                        \
+      __list_last->next = NULL;                                                \
+      if (__list_merges <= 1) {                                                \
+        (list)->head = __list_in;                                              \
+        (list)->tail = __list_last;                                            \
+        (list)->finger = NULL;                                                 \
+        break;                                                                 \
+      }                                                                        \
+      __list_run *= 2;                                                         \
+    }                                                                          \
+    list;                                                                      \
+  })
+
+/**
+ * Returns the node at position i
+ *
+ * Walks from whichever of head, tail and the list's finger (the node found
+ * by the previous LIST_AT) is closest to i, then moves the finger to the
+ * result. Visiting positions in order is therefore amortized O(1) per step.
+ * Any insertion or removal, other than an append, forgets the finger.
+ *
+ * @return pointer to list_type at position i, NULL if i is out of range
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param i zero based position of the node
+ */
+#define LIST_AT(list, i)                                                       \
+  ({                                                                           \
+    size_t __list_i = (i);                                                     \
+    typeof((list)->head) __list_at = NULL;                                     \
+    if (__list_i < (list)->length) {                                           \
+      size_t __list_from = 0;                                                  \
+      size_t __list_dist = __list_i;                                           \
+      __list_at = (list)->head;                                                \
+      if ((list)->length - 1 - __list_i < __list_dist) {                       \
+        __list_from = (list)->length - 1;                                      \
+        __list_dist = __list_from - __list_i;                                  \
+        __list_at = (list)->tail;                                              \
+      }                                                                        \
+      if ((list)->finger) {                                                    \
+        size_t __list_fi = (list)->finger_index;                               \
+        size_t __list_fdist = __list_fi > __list_i ? __list_fi - __list_i      \
+                                                   : __list_i - __list_fi;     \
+        if (__list_fdist < __list_dist) {                                      \
+          __list_from = __list_fi;                                             \
+          __list_at = (list)->finger;                                          \
+        }                                                                      \
+      }                                                                        \
+      for (; __list_from < __list_i; __list_from++)                            \
+        __list_at = __list_at->next;                                           \
+      for (; __list_from > __list_i; __list_from--)                            \
+        __list_at = __list_at->prev;                                           \
+      (list)->finger = __list_at;                                              \
+      (list)->finger_index = __list_i;                                         \
+    }                                                                          \
+    __list_at;                                                                 \
+  })
+
+/**
+ * Inserts an element so that it ends up at position i
+ *
+ * Finds the current node at i with LIST_AT and links the new element in
+ * front of it. The finger is left on the new node.
+ *
+ * @return size_t length of new list
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param i zero based position, at most the length of the list
+ * @param elem element of the same type as the list to insert
+ */
+#define LIST_INSERT_AT(list, i, elem)                                          \
+  ({                                                                           \
+    size_t __list_pos = (i);                                                   \
+    if (__list_pos >= (list)->length)                                          \
+      LIST_APPEND(list, elem);                                                 \
+    else if (!__list_pos)                                                      \
+      LIST_PREPEND(list, elem);                                                \
+    else {                                                                     \
+      typeof((list)->head) __list_next = LIST_AT(list, __list_pos);            \
+      typeof(__list_next) new_entry = _LIST_NODE_NEW(list);                    \
+      new_entry->entry = elem;                                                 \
+      new_entry->next = __list_next;                                           \
+      new_entry->prev = __list_next->prev;                                     \
+      __list_next->prev->next = new_entry;                                     \
+      __list_next->prev = new_entry;                                           \
+      ++(list)->length;                                                        \
+      (list)->finger = new_entry;                                              \
+    }                                                                          \
+    (list)->length;                                                            \
+  })
+
+/**
+ * Relocates every node of a list into one contiguous slab
+ *
+ * Nodes end up in memory in list order, which restores iteration speed after
+ * long append/delete churn has scattered them across the heap. The slab is
+ * allocated through the list's allocator and the old nodes are released.
+ * Pointers to nodes are invalidated, use LIST_COMPACT_MAP to be told where
+ * each node moved. The list is left untouched if the slab cannot be
+ * allocated.
+ *
+ * @return pointer to the list passed in
+ *
+ * @param list pointer to list_sentinal_type to compact
+ */
+#define LIST_COMPACT(list)                                                     \
+  LIST_COMPACT_MAP(list, __list_old, __list_new, {})
+
+/**
+ * Relocates every node of a list into one contiguous slab
+ *
+ * See LIST_COMPACT. callback runs once per node with old pointing at the
+ * original node and new at its replacement, before old is released.
+ *
+ * @return pointer to the list passed in
+ *
+ * @param list pointer to list_sentinal_type to compact
+ * @param old name for the original node inside callback
+ * @param new name for the relocated node inside callback
+ * @param callback code to be run for each relocated node
+ */
+#define LIST_COMPACT_MAP(list, old, new, callback)                             \
+  ({                                                                           \
+    size_t __list_len = (list)->length;                                        \
+    struct list_slab *__list_slab =                                            \
+        __list_len ? list_slab_new((list)->allocator, sizeof(*(list)->head),   \
+                                   __list_len)                                 \
+                   : NULL;                                                     \
+    if (__list_slab) {                                                         \
+      typeof((list)->head) __list_nodes = _LIST_SLAB_NODES(__list_slab);       \
+      _LIST_STAT_HOOK(list, allocs, on_alloc, __list_nodes,                    \
+                      __list_len * sizeof(*__list_nodes));                     \
+      typeof(__list_nodes) old = (list)->head;                                 \
+      for (size_t __i = 0; old; __i++) {                                       \
+        typeof(old) __list_next_old = old->next;                               \
+        typeof(old) new = &__list_nodes[__i];                                  \
+        new->entry = old->entry;                                               \
+        new->prev = __i ? new - 1 : NULL;                                      \
+        new->next = __list_next_old ? new + 1 : NULL;                          \
+        new->slab = __list_slab;                                               \
+        callback;                                                              \
+        _LIST_NODE_RELEASE(list, old);                                         \
+        old = __list_next_old;                                                 \
+      }                                                                        \
+      (list)->head = __list_nodes;                                             \
+      (list)->tail = &__list_nodes[__list_len - 1];                            \
+      (list)->finger = NULL;                                                   \
+      (list)->bulk = 1;                                                        \
+    }                                                                          \
+    list;                                                                      \
+  })
+
+/**
+ * Generic list pop
+ *
+ * For internal use only - see LIST_APPEND and LIST_PREPEND
+ */
+#define _LIST_POP(list, sentinal)                                              \
+  ({                                                                           \
+    typeof((list)->sentinal) __list_internal_temp = (list)->sentinal;          \
+    LIST_REMOVE(list, __list_internal_temp);                                   \
+    typeof(__list_internal_temp->entry) __list_internal_retval;                \
+    __list_internal_retval = __list_internal_temp->entry;                      \
+    LIST_NODE_FREE(list, __list_internal_temp);                                \
+    _LIST_STAT(list, pops, 1);                                                 \
+    __list_internal_retval;                                                    \
+  })
+
+/**
+ * List pop from front
+ *
+ * @return list_type element at head of list
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ */
+#define LIST_POPF(list) _LIST_POP(list, head)
+
+/**
+ * List pop from back
+ *
+ * @return list_type element at tail of list
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ */
+#define LIST_POPB(list) _LIST_POP(list, tail)
+
+/**
+ * Generic batch pop
+ *
+ * For internal use only - see LIST_POPF_N and LIST_POPB_N. Pops from first,
+ * following step, and fixes up back and last once at the end.
+ */
+#define _LIST_POP_N(list, n, out, first, step, last, back)                     \
+  ({                                                                           \
+    size_t __list_want = (n);                                                  \
+    size_t __list_popped = 0;                                                  \
+    typeof((list)->head) __list_node = (list)->first;                          \
+    for (; __list_node && __list_popped < __list_want; __list_popped++) {      \
+      typeof(__list_node) __list_next = __list_node->step;                     \
+      (out)[__list_popped] = __list_node->entry;                               \
+      LIST_NODE_FREE(list, __list_node);                                       \
+      __list_node = __list_next;                                               \
+    }                                                                          \
+    (list)->first = __list_node;                                               \
+    if (__list_node)                                                           \
+      __list_node->back = NULL;                                                \
+    else                                                                       \
+      (list)->last = NULL;                                                     \
+    (list)->length -= __list_popped;                                           \
+    (list)->finger = NULL;                                                     \
+    _LIST_STAT(list, pops, __list_popped);                                     \
+    __list_popped;                                                             \
+  })
+
+/**
+ * List pop of up to n elements from front
+ *
+ * Same as calling LIST_POPF n times, but head and length are only updated
+ * once. Freed nodes go to the node cache like they do for LIST_POPF.
+ *
+ * @return size_t number of elements popped, less than n if the list ran out
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param n maximum number of elements to pop
+ * @param out array of at least n elements receiving the entries, head first
+ */
+#define LIST_POPF_N(list, n, out)                                              \
+  _LIST_POP_N(list, n, out, head, next, tail, prev)
+
+/**
+ * List pop of up to n elements from back
+ *
+ * Same as calling LIST_POPB n times, but tail and length are only updated
+ * once. Freed nodes go to the node cache like they do for LIST_POPB.
+ *
+ * @return size_t number of elements popped, less than n if the list ran out
+ *
+ * @param list pointer to list_sentinal_type storing list metadata
+ * @param n maximum number of elements to pop
+ * @param out array of at least n elements receiving the entries, tail first
+ */
+#define LIST_POPB_N(list, n, out)                                              \
+  _LIST_POP_N(list, n, out, tail, prev, head, next)
+
+/**
+ * Generic batch detach
+ *
+ * For internal use only - see LIST_DETACHF_N and LIST_DETACHB_N
+ */
+#define _LIST_DETACH_N(list, n, first, step, last, back)                       \
+  ({                                                                           \
+    size_t __list_want = (n);                                                  \
+    typeof(*(list)) __list_out = {0};                                          \
+    __list_out.allocator = (list)->allocator;                                  \
+    _LIST_STORE_DESTRUCTOR(&__list_out, _LIST_GET_DESTRUCTOR(list));           \
+    if (__list_want > (list)->length)                                          \
+      __list_want = (list)->length;                                            \
+    if (__list_want) {                                                         \
+      _LIST_INLINE_EVICT_N(list, (list)->first, step, __list_want);            \
+      typeof((list)->head) __list_end = (list)->first;                         \
+      for (size_t __i = 1; __i < __list_want; __i++)                           \
+        __list_end = __list_end->step;                                         \
+      __list_out.first = (list)->first;                                        \
+      __list_out.last = __list_end;                                            \
+      __list_out.length = __list_want;                                         \
+      __list_out.bulk = (list)->bulk;                                          \
+      (list)->first = __list_end->step;                                        \
+      __list_end->step = NULL;                                                 \
+      if ((list)->first)                                                       \
+        (list)->first->back = NULL;                                            \
+      else                                                                     \
+        (list)->last = NULL;                                                   \
+      (list)->length -= __list_want;                                           \
+      (list)->finger = NULL;                                                   \
+    }                                                                          \
+    __list_out;                                                                \
+  })
+
+/**
+ * Detaches up to n elements from the front as a new list
+ *
+ * No nodes are allocated, freed or copied: the first n nodes are cut off in
+ * one walk and returned, in order, in a list_sentinal_type with the same
+ * destructor and allocator as list. Elements in inline slots of list are
+ * moved to allocated nodes first.
+ *
+ * e.g.
+ *
+ * ```
+ * struct list_sentinal_int batch = LIST_DETACHF_N(&work, 64);
+ * LIST_FOR_EACH(&batch, job, { run(job->entry); });
+ * LIST_DESTROY(&batch);
+ * ```
+ *
+ * @return list_sentinal_type holding the detached elements
+ *
+ * @param list pointer to list_sentinal_type to take elements from
+ * @param n maximum number of elements to detach
+ */
+#define LIST_DETACHF_N(list, n) _LIST_DETACH_N(list, n, head, next, tail, prev)
+
+/**
+ * Detaches up to n elements from the back as a new list
+ *
+ * Same as LIST_DETACHF_N for the last n nodes, which keep their order.
+ *
+ * @return list_sentinal_type holding the detached elements
+ *
+ * @param list pointer to list_sentinal_type to take elements from
+ * @param n maximum number of elements to detach
+ */
+#define LIST_DETACHB_N(list, n) _LIST_DETACH_N(list, n, tail, prev, head, next)
+
+/**
+ * Generic list safe iterator
+ *
+ * For internal use only - see LIST_FOR_EACH_SAFE and LIST_FOR_EACH_REV_SAFE
+ */
+#define _LIST_FOR_EACH(list, var, sentinal, direction, callback)               \
+  do {                                                                         \
+    _LIST_STAT(list, traversals, 1);                                           \
+    _LIST_STAT(list, visited, (list)->length);                                 \
+    typeof((list)->sentinal) var = (list)->sentinal;                           \
+    while (var) {                                                              \
+      callback;                                                                \
+      var = var->direction;                                                    \
+    }                                                                          \
+  } while (0)
+
+/**
+ * List iterator
+ *
+ * Iterates from head to tail
+ * Does not allows deletion of elemnts during iteration
+ *
+ * @param list pointer to list_sentinal type
+ * @param var name for variable to be used inside callback
+ * @param callback code to be run on each iteration
+ */
+#define LIST_FOR_EACH(list, var, callback)                                     \
+  _LIST_FOR_EACH(list, var, head, next, callback)
+
+/**
+ * List reverse iterator
+ *
+ * Iterates from tail to head
+ * Does not allows deletion of elemnts during iteration
+ *
+ * @param list pointer to list_sentinal type
+ * @param var name for variable to be used inside callback
+ * @param callback code to be run on each iteration
+ */
+#define LIST_FOR_EACH_REV(list, var, callback)                                 \
+  _LIST_FOR_EACH(list, var, tail, prev, callback)
+
+/**
+ * Generic prefetching iterator
+ *
+ * For internal use only - see LIST_FOR_EACH_PREFETCH and
+ * LIST_FOR_EACH_REV_PREFETCH
+ *
+ * A lookahead pointer runs distance nodes ahead of var. Each step advances it
+ * by one node and prefetches that node, so fetching it overlaps with running
+ * the callback on the nodes in between.
+ */
+#define _LIST_FOR_EACH_PREFETCH(list, var, distance, sentinal, direction,      \
+                                callback)                                      \
+  do {                                                                         \
+    _LIST_STAT(list, traversals, 1);                                           \
+    _LIST_STAT(list, visited, (list)->length);                                 \
+    typeof((list)->sentinal) var = (list)->sentinal;                           \
+    typeof(var) __list_ahead = var;                                            \
+    for (size_t __list_d = (distance); __list_ahead && __list_d; __list_d--) { \
+      __list_ahead = __list_ahead->direction;                                  \
+      __builtin_prefetch(__list_ahead);                                        \
+    }                                                                          \
+    while (var) {                                                              \
+      callback;                                                                \
+      var = var->direction;                                                    \
+      if (__list_ahead) {                                                      \
+        __list_ahead = __list_ahead->direction;                                \
+        __builtin_prefetch(__list_ahead);                                      \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Prefetching list iterator
+ *
+ * Same as LIST_FOR_EACH, but prefetches the node distance steps ahead of the
+ * current one. Helps on long lists whose nodes are scattered in memory, where
+ * every step would otherwise be a cache miss. Good distances depend on the
+ * cost of the callback, a few nodes is a reasonable start.
+ *
+ * @param list pointer to list_sentinal type
+ * @param var name for variable to be used inside callback
+ * @param distance number of nodes to prefetch ahead
+ * @param callback code to be run on each iteration
+ */
+#define LIST_FOR_EACH_PREFETCH(list, var, distance, callback)                  \
+  _LIST_FOR_EACH_PREFETCH(list, var, distance, head, next, callback)
+
+/**
+ * Prefetching list reverse iterator
+ *
+ * Same as LIST_FOR_EACH_REV, see LIST_FOR_EACH_PREFETCH
+ *
+ * @param list pointer to list_sentinal type
+ * @param var name for variable to be used inside callback
+ * @param distance number of nodes to prefetch ahead
+ * @param callback code to be run on each iteration
+ */
+#define LIST_FOR_EACH_REV_PREFETCH(list, var, distance, callback)              \
+  _LIST_FOR_EACH_PREFETCH(list, var, distance, tail, prev, callback)
+
+/**
+ * Copies every element of a list, head to tail, into an array
+ *
+ * The list is walked with LIST_FOR_EACH_PREFETCH, so scattered nodes are
+ * fetched ahead of the copy.
+ *
+ * @return buf
+ *
+ * @param list pointer to list_sentinal_type to copy from
+ * @param buf array with room for at least (list)->length elements
+ *
+ * e.g.
+ *
+ * int *values = malloc(my_list.length * sizeof(*values));
+ * qsort(LIST_TO_ARRAY(&my_list, values), my_list.length, sizeof(int), cmp);
+ */
+#define LIST_TO_ARRAY(list, buf)                                               \
+  ({                                                                           \
+    typeof(&(list)->head->entry) __list_buf = (buf);                           \
+    size_t __list_i = 0;                                                       \
+    LIST_FOR_EACH_PREFETCH(list, __list_elem, 8,                               \
+                           { __list_buf[__list_i++] = __list_elem->entry; });  \
+    __list_buf;                                                                \
+  })
+
+/**
+ * Parallel list iterator
+ *
+ * Runs callback on every node, splitting the list into nthreads ranges of
+ * roughly length / nthreads nodes each. The split points are found with a
+ * single walk of the list, after which the ranges are handed to OpenMP
+ * threads. Without -fopenmp the ranges run one after the other on the calling
+ * thread, so the result is the same either way.
+ *
+ * Worth it only when the callback is expensive compared to following a
+ * pointer. Callbacks run concurrently: they must not add, remove or move
+ * nodes of the list, must synchronize any shared state themselves and must
+ * not break or return out of the loop.
+ *
+ * @param list pointer to list_sentinal type
+ * @param var name for variable to be used inside callback
+ * @param nthreads number of ranges, and threads, to split the list into, at
+ * most 256
+ * @param callback code to be run on each iteration
+ */
+#define LIST_PARALLEL_FOR_EACH(list, var, nthreads, callback)                  \
+  do {                                                                         \
+    _LIST_STAT(list, traversals, 1);                                           \
+    _LIST_STAT(list, visited, (list)->length);                                 \
+    size_t __list_nthreads = (nthreads);                                       \
+    if (__list_nthreads > _LIST_PARALLEL_MAX_THREADS)                          \
+      __list_nthreads = _LIST_PARALLEL_MAX_THREADS;                            \
+    if (__list_nthreads > (list)->length)                                      \
+      __list_nthreads = (list)->length;                                        \
+    if (!__list_nthreads)                                                      \
+      __list_nthreads = 1;                                                     \
+    typeof((list)->head) __list_starts[__list_nthreads + 1];                   \
+    size_t __list_step = (list)->length / __list_nthreads;                     \
+    size_t __list_extra = (list)->length % __list_nthreads;                    \
+    typeof((list)->head) __list_node = (list)->head;                           \
+    for (size_t __list_t = 0; __list_t < __list_nthreads; __list_t++) {        \
+      __list_starts[__list_t] = __list_node;                                   \
+      for (size_t __list_n = __list_step + (__list_t < __list_extra);          \
+           __list_n; __list_n--)                                               \
+        __list_node = __list_node->next;                                       \
+    }                                                                          \
+    __list_starts[__list_nthreads] = NULL;                                     \
+    _LIST_PARALLEL_FOR(__list_nthreads)                                        \
+    for (size_t __list_t = 0; __list_t < __list_nthreads; __list_t++)          \
+      for (typeof((list)->head) var = __list_starts[__list_t];                 \
+           var != __list_starts[__list_t + 1]; var = var->next) {              \
+        callback;                                                              \
+      }                                                                        \
+  } while (0)
+
+/**
+ * Generic list safe iterator
+ *
+ * For internal use only - see LIST_FOR_EACH_SAFE and LIST_FOR_EACH_REV_SAFE
+ */
+#define _LIST_FOR_EACH_SAFE(list, var, temp, sentinal, direction, callback)    \
+  do {                                                                         \
+    _LIST_STAT(list, traversals, 1);                                           \
+    _LIST_STAT(list, visited, (list)->length);                                 \
+    typeof((list)->sentinal) var = (list)->sentinal;                           \
+    typeof(var) temp = NULL;                                                   \
+    if (var)                                                                   \
+      temp = var->direction;                                                   \
+    while (var) {                                                              \
+      callback;                                                                \
+      var = temp;                                                              \
+      if (var)                                                                 \
+        temp = var->direction;                                                 \
+    }                                                                          \
+  } while (0)
+
+/**
+ * List safe iterator
+ *
+ * Allows deletion of elemnts during iteration
+ *
+ * @param list pointer to list_sentinal type
+ * @param var name for variable to be used inside callback
+ * @param temp name for temporary variable - do not modify in callback
+ * @param callback code to be run on each iteration
+ */
+#define LIST_FOR_EACH_SAFE(list, var, temp, callback)                          \
+  _LIST_FOR_EACH_SAFE(list, var, temp, head, next, callback)
+
+/**
+ * List safe reverse iterator
+ *
+ * Allows deletion of elemnts during iteration
+ *
+ * @param list pointer to list_sentinal type
+ * @param var name for variable to be used inside callback
+ * @param temp name for temporary variable - do not modify in callback
+ * @param callback code to be run on each iteration
+ */
+#define LIST_FOR_EACH_REV_SAFE(list, var, temp, callback)                      \
+  _LIST_FOR_EACH_SAFE(list, var, temp, tail, prev, callback)
+
+/**
+ * Removes every element for which predicate is false, in a single pass
+ *
+ * Kept nodes are relinked as the walk goes and head, tail and length are
+ * fixed up once at the end. Rejected elements are passed to the destructor
+ * and their nodes released as with LIST_DEL. predicate must not modify the
+ * list.
+ *
+ * @return size_t number of elements removed
+ *
+ * @param list pointer to list_sentinal_type to filter
+ * @param var name for the list_type pointer to be used inside predicate
+ * @param predicate expression that is nonzero for elements to keep
+ *
+ * e.g.
+ *
+ * LIST_FILTER(&timers, t, t->entry.deadline > now);
+ */
+#define LIST_FILTER(list, var, predicate)                                      \
+  ({                                                                           \
+    typeof((list)->head) var = (list)->head;                                   \
+    typeof(var) __list_kept = NULL;                                            \
+    size_t __list_removed = 0;                                                 \
+    while (var) {                                                              \
+      typeof(var) __list_next = var->next;                                     \
+      if (predicate) {                                                         \
+        var->prev = __list_kept;                                               \
+        if (__list_kept)                                                       \
+          __list_kept->next = var;                                             \
+        else                                                                   \
+          (list)->head = var;                                                  \
+        __list_kept = var;                                                     \
+      } else {                                                                 \
+        _LIST_DESTRUCT(list, var->entry);                                      \
+        LIST_NODE_FREE(list, var);                                             \
+        __list_removed++;                                                      \
+      }                                                                        \
+      var = __list_next;                                                       \
+    }                                                                          \
+    if (__list_kept)                                                           \
+      __list_kept->next = NULL;                                                \
+    else                                                                       \
+      (list)->head = NULL;                                                     \
+    (list)->tail = __list_kept;                                                \
+    (list)->length -= __list_removed;                                          \
+    if (__list_removed)                                                        \
+      (list)->finger = NULL;                                                   \
+    _LIST_STAT(list, dels, __list_removed);                                    \
+    __list_removed;                                                            \
+  })
+
+/**
+ * Replaces every element with the value of expr, in place
+ *
+ * No node is allocated or moved.
+ *
+ * @return pointer to the list passed in
+ *
+ * @param list pointer to list_sentinal_type to map
+ * @param var name for the list_type pointer to be used inside expr
+ * @param expr expression giving the new value of var->entry
+ *
+ * e.g.
+ *
+ * LIST_MAP_INPLACE(&my_list, elem, elem->entry * 2);
+ */
+#define LIST_MAP_INPLACE(list, var, expr)                                      \
+  ({                                                                           \
+    LIST_FOR_EACH(list, var, { var->entry = (expr); });                        \
+    list;                                                                      \
+  })
+
+/**
+ * Folds the list from head to tail into a single value
+ *
+ * acc starts out as init and is replaced by the value of expr for every
+ * element in turn.
+ *
+ * @return final value of acc, of the type of init
+ *
+ * @param list pointer to list_sentinal_type to reduce
+ * @param var name for the list_type pointer to be used inside expr
+ * @param acc name for the accumulator to be used inside expr
+ * @param init initial value of the accumulator
+ * @param expr expression giving the next value of acc
+ *
+ * e.g.
+ *
+ * long sum = LIST_REDUCE(&my_list, elem, total, 0L, total + elem->entry);
+ */
+#define LIST_REDUCE(list, var, acc, init, expr)                                \
+  ({                                                                           \
+    typeof(init) acc = (init);                                                 \
+    LIST_FOR_EACH(list, var, { acc = (expr); });                               \
+    acc;                                                                       \
+  })
+
+/**
+ * Generic list teardown
+ *
+ * For internal use only - see LIST_DESTROY and LIST_ABANDON
+ *
+ * Walks the chain once without unlinking anything, calling the destructor on
+ * every entry, returning bulk slab nodes to their slab and, if free_nodes,
+ * freeing every other node. Resets the list to empty.
+ */
+#define _LIST_TEARDOWN(list, free_nodes)                                       \
+  do {                                                                         \
+    typeof((list)->head) __list_node = (list)->head;                           \
+    while (__list_node) {                                                      \
+      typeof(__list_node) __list_next = __list_node->next;                     \
+      _LIST_DESTRUCT(list, __list_node->entry);                                \
+      if (__list_node->slab)                                                   \
+        _LIST_SLAB_RELEASE(list, __list_node->slab);                           \
+      else if ((free_nodes) && !_LIST_INLINE_OWNS(list, __list_node)) {        \
+        _LIST_STAT_HOOK(list, frees, on_free, __list_node,                     \
+                        sizeof(*__list_node));                                 \
+        _LIST_FREE(list, __list_node, sizeof(*__list_node));                   \
+      }                                                                        \
+      __list_node = __list_next;                                               \
+    }                                                                          \
+    (list)->head = (list)->tail = NULL;                                        \
+    (list)->length = 0;                                                        \
+    (list)->finger = NULL;                                                     \
+    (list)->finger_index = 0;                                                  \
+    memset((list)->inline_used, 0, sizeof((list)->inline_used));               \
+  } while (0)
+
+/**
+ * List destructor
+ *
+ * Calls the destructor on every element and frees every node and the node
+ * cache. The list is left empty and can be reused.
+ *
+ * @param list pointer to list_sentinal type to be destroyed
+ */
+#define LIST_DESTROY(list)                                                     \
+  do {                                                                         \
+    _LIST_TEARDOWN(list, 1);                                                   \
+    LIST_SHRINK(list);                                                         \
+    (list)->bulk = 0;                                                          \
+  } while (0);
+
+/**
+ * List destructor for lists whose allocator is about to be torn down
+ *
+ * Same as LIST_DESTROY, but nodes and cached nodes are not handed back to
+ * the allocator one at a time. Use this right before releasing an arena or
+ * pool (e.g. with list_pool_destroy) that owns every node of the list, so
+ * that teardown costs one walk for the destructor, or nothing at all if the
+ * list has no destructor and no bulk slab nodes. Nodes in bulk slabs are
+ * still returned, since the slab may hold nodes of other lists too.
+ *
+ * @param list pointer to list_sentinal type to be destroyed
+ */
+#define LIST_ABANDON(list)                                                     \
+  do {                                                                         \
+    if (_LIST_GET_DESTRUCTOR(list) || (list)->bulk)                            \
+      _LIST_TEARDOWN(list, 0);                                                 \
+    for (typeof((list)->head) __list_node = (list)->bulk ? (list)->cache       \
+                                                         : NULL;               \
+         __list_node;) {                                                       \
+      typeof(__list_node) __list_next = __list_node->next;                     \
+      if (__list_node->slab)                                                   \
+        _LIST_SLAB_RELEASE(list, __list_node->slab);                           \
+      __list_node = __list_next;                                               \
+    }                                                                          \
+    (list)->head = (list)->tail = (list)->finger = NULL;                       \
+    (list)->length = (list)->finger_index = 0;                                 \
+    (list)->cache = NULL;                                                      \
+    (list)->cache_length = 0;                                                  \
+    memset((list)->inline_used, 0, sizeof((list)->inline_used));               \
+    (list)->bulk = 0;                                                          \
+  } while (0)
+
+/**
+ * Runs code for every node of list and of its node cache
+ *
+ * For internal use only - see LIST_MEMORY_USAGE
+ */
+#define _LIST_HELD_FOR_EACH(list, var, code)                                   \
+  for (int __list_pass = 0; __list_pass < 2; __list_pass++)                    \
+    for (typeof((list)->head) var =                                            \
+             __list_pass ? (list)->cache : (list)->head;                       \
+         var; var = var->next) {                                               \
+      code;                                                                    \
+    }
+
+/**
+ * Reports the memory used by a list
+ *
+ * Looks at the inline slots and, if the list has taken bulk slab nodes, at
+ * every node and cached node. A slab holding nodes of several lists, e.g.
+ * after a split, counts fully towards each of them.
+ *
+ * e.g.
+ *
+ * ```
+ * struct list_memory usage = LIST_MEMORY_USAGE(&list);
+ * printf("%zu of %zu bytes are elements\n", usage.payload,
+ *        list_memory_total(usage));
+ * ```
+ *
+ * @return struct list_memory, see there
+ *
+ * @param list pointer to list_sentinal_type
+ */
+#define LIST_MEMORY_USAGE(list)                                                \
+  ({                                                                           \
+    struct list_memory __list_mem = {0};                                       \
+    size_t __list_node = sizeof(*(list)->head);                                \
+    size_t __list_own = (list)->length + (list)->cache_length;                 \
+    for (size_t __i = 0; __i != LIST_INLINE_SLOTS(list); __i++)                \
+      if ((list)->inline_used[__i])                                            \
+        __list_own--;                                                          \
+      else                                                                     \
+        __list_mem.slack += __list_node;                                       \
+    if ((list)->bulk) {                                                        \
+      /* Count each slab once, however many of its nodes the list holds */     \
+      _LIST_HELD_FOR_EACH(list, __list_held, {                                 \
+        if (__list_held->slab)                                                 \
+          __list_held->slab->marked = 0;                                       \
+      });                                                                      \
+      _LIST_HELD_FOR_EACH(list, __list_held, {                                 \
+        struct list_slab *__list_slab = __list_held->slab;                     \
+        if (__list_slab) {                                                     \
+          __list_own--;                                                        \
+          if (!__list_slab->marked) {                                          \
+            size_t __list_nodes =                                              \
+                (__list_slab->bytes - _LIST_SLAB_HEADER) / __list_node;        \
+            __list_slab->marked = 1;                                           \
+            __list_mem.slack +=                                                \
+                (__list_nodes - __list_slab->live) * __list_node;              \
+            __list_mem.allocator +=                                            \
+                _LIST_SLAB_HEADER + list_allocator_overhead(                   \
+                                        __list_slab->allocator,                \
+                                        __list_slab->bytes);                   \
+          }                                                                    \
+        }                                                                      \
+      });                                                                      \
+    }                                                                          \
+    __list_mem.payload = (list)->length * sizeof((list)->head->entry);         \
+    __list_mem.links = (list)->length * __list_node - __list_mem.payload +     \
+                       sizeof(*(list)) - sizeof((list)->inline_nodes);         \
+    __list_mem.slack += (list)->cache_length * __list_node;                    \
+    __list_mem.allocator +=                                                    \
+        __list_own * list_allocator_overhead((list)->allocator, __list_node);  \
+    __list_mem;                                                                \
+  })
+
+/**
+ * List constructor
+ *
+ * Since this only initializes and returns a element of list_sentinal_T,
+ * this is returned on the stack.
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ */
+#define new_list(T, d)                                                         \
+  ({                                                                           \
+    struct list_sentinal_##T __new_list_data = {0};                            \
+    _LIST_SET_DESTRUCTOR(&__new_list_data, d);                                 \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * List constructor with a custom node allocator
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ * @param a pointer to struct list_allocator used for every node of the list,
+ * e.g. &pool.allocator for a struct list_pool
+ */
+#define new_list_alloc(T, d, a)                                                \
+  ({                                                                           \
+    struct list_sentinal_##T __new_list_data = new_list(T, d);                 \
+    __new_list_data.allocator = a;                                             \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * List constructor from an array
+ *
+ * Builds a list holding a copy of array, in order, with every node in a
+ * single bulk slab (see LIST_APPEND_ARRAY). The list is empty if the slab
+ * cannot be allocated.
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ * @param array elements to copy into the list
+ * @param len length of array
+ */
+#define LIST_FROM_ARRAY(T, d, array, len)                                      \
+  ({                                                                           \
+    struct list_sentinal_##T __new_list_data = new_list(T, d);                 \
+    LIST_APPEND_ARRAY(&__new_list_data, array, len);                           \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * Writes a list to fd in the flat file format
+ *
+ * See "Flat file format". Elements are copied into a buffer of about 64KiB
+ * and written out a buffer at a time.
+ *
+ * @return 0 on success, -1 with errno set on failure
+ *
+ * @param list pointer to list_sentinal_type to save
+ * @param fd file descriptor to write to, normally of an empty file since
+ * LIST_LOAD and LIST_VIEW_OPEN read from the start of the file
+ */
+#define LIST_SAVE(list, fd)                                                    \
+  ({                                                                           \
+    int __list_fd = (fd);                                                      \
+    size_t __list_size = sizeof((list)->head->entry);                          \
+    struct list_file_header __list_header = {                                  \
+        _LIST_FILE_MAGIC, _LIST_FILE_VERSION, __list_size, (list)->length};    \
+    char __list_raw[_LIST_FILE_HEADER] = {0};                                  \
+    memcpy(__list_raw, &__list_header, sizeof(__list_header));                 \
+    int __list_err =                                                           \
+        list_file_write(__list_fd, __list_raw, sizeof(__list_raw));            \
+    size_t __list_batch = __list_size < 65536 ? 65536 / __list_size : 1;       \
+    if (__list_batch > (list)->length)                                         \
+      __list_batch = (list)->length;                                           \
+    typeof(&(list)->head->entry) __list_buf =                                  \
+        __list_err || !__list_batch ? NULL                                     \
+                                    : malloc(__list_batch * __list_size);      \
+    if (__list_batch && !__list_buf)                                           \
+      __list_err = -1;                                                         \
+    size_t __list_n = 0;                                                       \
+    for (typeof((list)->head) __list_node = __list_err ? NULL : (list)->head;  \
+         __list_node; __list_node = __list_node->next) {                       \
+      __list_buf[__list_n++] = __list_node->entry;                             \
+      if (__list_n == __list_batch || !__list_node->next) {                    \
+        if (list_file_write(__list_fd, __list_buf, __list_n * __list_size)) {  \
+          __list_err = -1;                                                     \
+          break;                                                               \
+        }                                                                      \
+        __list_n = 0;                                                          \
+      }                                                                        \
+    }                                                                          \
+    free(__list_buf);                                                          \
+    __list_err;                                                                \
+  })
+
+/**
+ * Appends the elements of a file written by LIST_SAVE to a list
+ *
+ * The file is mapped and its entries are copied into a single bulk slab, as
+ * with LIST_APPEND_ARRAY, so loading costs one allocation whatever the
+ * length. Use LIST_VIEW_OPEN to read the entries without building a list.
+ *
+ * @return 0 on success, -1 with errno set on failure, EINVAL if the file was
+ * not saved from a list of the same type
+ *
+ * @param list pointer to list_sentinal_type to append to
+ * @param fd file descriptor of the file to load
+ */
+#define LIST_LOAD(list, fd)                                                    \
+  ({                                                                           \
+    size_t __list_count, __list_map_size;                                      \
+    void *__list_map = list_file_map(fd, sizeof((list)->head->entry),          \
+                                     &__list_count, &__list_map_size);         \
+    int __list_err = __list_map ? 0 : -1;                                      \
+    if (__list_map) {                                                          \
+      size_t __list_before = (list)->length;                                   \
+      LIST_APPEND_ARRAY(list,                                                  \
+                        (typeof(&(list)->head->entry))(                        \
+                            (char *)__list_map + _LIST_FILE_HEADER),           \
+                        __list_count);                                         \
+      munmap(__list_map, __list_map_size);                                     \
+      if ((list)->length != __list_before + __list_count) {                    \
+        errno = ENOMEM;                                                        \
+        __list_err = -1;                                                       \
+      }                                                                        \
+    }                                                                          \
+    __list_err;                                                                \
+  })
+
+/**
+ * Read only view of a file written by LIST_SAVE
+ *
+ * entries points straight into a read only mapping of the file, so opening a
+ * view costs the same whatever the length and pages are read in on first
+ * access.
+ *
+ * @param T type parameter for list
+ */
+#define LIST_VIEW_DEFN(T)                                                      \
+  struct list_view_##T {                                                       \
+    const T *entries;                                                          \
+    size_t length;                                                             \
+    void *map; /* Mapping of the whole file, NULL if not open */               \
+    size_t map_size;                                                           \
+  };
+EXPAND(LIST_VIEW_DEFN, TYPE)
+#undef LIST_VIEW_DEFN
+
+/**
+ * Opens a read only view of a file written by LIST_SAVE
+ *
+ * The view stays valid after fd is closed, until LIST_VIEW_CLOSE.
+ *
+ * @return 0 on success, -1 with errno set on failure, EINVAL if the file was
+ * not saved from a list of the same type
+ *
+ * @param view pointer to list_view_type to open
+ * @param fd file descriptor of the file to map
+ */
+#define LIST_VIEW_OPEN(view, fd)                                               \
+  ({                                                                           \
+    (view)->map = list_file_map(fd, sizeof(*(view)->entries),                  \
+                                &(view)->length, &(view)->map_size);           \
+    if ((view)->map)                                                           \
+      (view)->entries = (void *)((char *)(view)->map + _LIST_FILE_HEADER);     \
+    else {                                                                     \
+      (view)->entries = NULL;                                                  \
+      (view)->length = (view)->map_size = 0;                                   \
+    }                                                                          \
+    (view)->map ? 0 : -1;                                                      \
+  })
+
+/**
+ * Closes a view opened with LIST_VIEW_OPEN
+ *
+ * @param view pointer to list_view_type to close
+ */
+#define LIST_VIEW_CLOSE(view)                                                  \
+  do {                                                                         \
+    if ((view)->map)                                                           \
+      munmap((view)->map, (view)->map_size);                                   \
+    (view)->map = NULL;                                                        \
+    (view)->entries = NULL;                                                    \
+    (view)->length = (view)->map_size = 0;                                     \
+  } while (0)
+
+/**
+ * Unrolled list
+ *
+ * An unrolled list stores up to LIST_CHUNK_SIZE entries in each node
+ * (defaults to 16), which cuts the per element overhead of small types and
+ * lets iteration walk contiguous arrays. Entries only live at the ends of the
+ * list, so it supports APPEND, PREPEND, POPF, POPB and iteration, but not
+ * removal from the middle.
+ *
+ * e.g.
+ *
+ * ```
+ * #define TYPE int
+ * #define LIST_CHUNK_SIZE 32
+ * #include "list.h"
+ * #undef LIST_CHUNK_SIZE
+ * #undef TYPE
+ *
+ * struct list_chunk_sentinal_int list = new_chunk_list(int, NULL);
+ * LIST_CHUNK_APPEND(&list, 5);
+ * LIST_CHUNK_FOR_EACH(&list, elem, { printf("%d\n", *elem); });
+ * LIST_CHUNK_DESTROY(&list);
+ * ```
+ */
+#ifdef LIST_CHUNK_SIZE
+#define _LIST_CHUNK_N LIST_CHUNK_SIZE
+#else
+#define _LIST_CHUNK_N 16
+#endif
+
+/**
+ * Defines parametrized unrolled list types
+ *
+ * Live entries of a chunk are entries[start] to entries[start + count - 1].
+ *
+ * @param T type parameter for list
+ * @param N number of entries per chunk
+ */
+#define LIST_CHUNK_DEFN(T, N)                                                  \
+  struct list_chunk_##T {                                                      \
+    struct list_chunk_##T *next;                                               \
+    struct list_chunk_##T *prev;                                               \
+    unsigned int start;                                                        \
+    unsigned int count;                                                        \
+    T entries[N];                                                              \
+  };                                                                           \
+  struct list_chunk_sentinal_##T {                                             \
+    struct list_chunk_##T *head;                                               \
+    struct list_chunk_##T *tail;                                               \
+    size_t length;                                                             \
+    list_destructor_##T destructor;                                            \
+    struct list_allocator *allocator; /* NULL to use malloc/free */            \
+  };
+EXPAND1(LIST_CHUNK_DEFN, TYPE, _LIST_CHUNK_N)
+#undef LIST_CHUNK_DEFN
+#undef _LIST_CHUNK_N
+
+/**
+ * Number of entries a chunk of list can hold
+ *
+ * @param list pointer to list_chunk_sentinal_type
+ */
+#define LIST_CHUNK_CAPACITY(list)                                              \
+  (sizeof((list)->head->entries) / sizeof((list)->head->entries[0]))
+
+/**
+ * Generic unrolled list add
+ *
+ * For internal use only - see LIST_CHUNK_APPEND and LIST_CHUNK_PREPEND
+ *
+ * A new chunk is linked in at top when the top chunk has no room left on the
+ * side facing away from the list. Its entries start at first.
+ */
+#define _LIST_CHUNK_ADD(list, elem, top, bottom, direction, reverse, full,     \
+                        first, slot)                                           \
+  ({                                                                           \
+    typeof((list)->top) __list_chunk = (list)->top;                            \
+    if (!__list_chunk || (full)) {                                             \
+      __list_chunk = _LIST_ALLOC(list, sizeof(*__list_chunk));                 \
+      __list_chunk->direction = NULL;                                          \
+      __list_chunk->reverse = (list)->top;                                     \
+      __list_chunk->start = first;                                             \
+      __list_chunk->count = 0;                                                 \
+      if ((list)->top)                                                         \
+        (list)->top->direction = __list_chunk;                                 \
+      else                                                                     \
+        (list)->bottom = __list_chunk;                                         \
+      (list)->top = __list_chunk;                                              \
+    }                                                                          \
+    __list_chunk->entries[slot] = elem;                                        \
+    __list_chunk->count++;                                                     \
+    ++(list)->length;                                                          \
+  })
+
+/**
+ * Append an element to the tail of an unrolled list
+ *
+ * @return size_t length of new list
+ *
+ * @param list pointer to list_chunk_sentinal_type storing list metadata
+ * @param elem element of the same type as the list to append
+ */
+#define LIST_CHUNK_APPEND(list, elem)                                          \
+  _LIST_CHUNK_ADD(                                                             \
+      list, elem, tail, head, next, prev,                                      \
+      __list_chunk->start + __list_chunk->count == LIST_CHUNK_CAPACITY(list),  \
+      0, __list_chunk->start + __list_chunk->count)
+
+/**
+ * Prepend an element to the head of an unrolled list
+ *
+ * @return size_t length of new list
+ *
+ * @param list pointer to list_chunk_sentinal_type storing list metadata
+ * @param elem element of the same type as the list to prepend
+ */
+#define LIST_CHUNK_PREPEND(list, elem)                                         \
+  _LIST_CHUNK_ADD(list, elem, head, tail, prev, next,                          \
+                  __list_chunk->start == 0, LIST_CHUNK_CAPACITY(list),         \
+                  --__list_chunk->start)
+
+/**
+ * Generic unrolled list pop
+ *
+ * For internal use only - see LIST_CHUNK_POPF and LIST_CHUNK_POPB
+ */
+#define _LIST_CHUNK_POP(list, sentinal, other, direction, reverse, slot)       \
+  ({                                                                           \
+    typeof((list)->sentinal) __list_chunk = (list)->sentinal;                  \
+    typeof(__list_chunk->entries[0]) __list_internal_retval =                  \
+        __list_chunk->entries[slot];                                           \
+    (list)->length--;                                                          \
+    if (!--__list_chunk->count) {                                              \
+      (list)->sentinal = __list_chunk->direction;                              \
+      if ((list)->sentinal)                                                    \
+        (list)->sentinal->reverse = NULL;                                      \
+      else                                                                     \
+        (list)->other = NULL;                                                  \
+      _LIST_FREE(list, __list_chunk, sizeof(*__list_chunk));                   \
+    }                                                                          \
+    __list_internal_retval;                                                    \
+  })
+
+/**
+ * Unrolled list pop from front
+ *
+ * @return element at head of list
+ *
+ * @param list pointer to list_chunk_sentinal_type storing list metadata
+ */
+#define LIST_CHUNK_POPF(list)                                                  \
+  _LIST_CHUNK_POP(list, head, tail, next, prev, __list_chunk->start++)
+
+/**
+ * Unrolled list pop from back
+ *
+ * @return element at tail of list
+ *
+ * @param list pointer to list_chunk_sentinal_type storing list metadata
+ */
+#define LIST_CHUNK_POPB(list)                                                  \
+  _LIST_CHUNK_POP(list, tail, head, prev, next,                                \
+                  __list_chunk->start + __list_chunk->count - 1)
+
+/**
+ * Unrolled list iterator
+ *
+ * Iterates from head to tail
+ * Does not allows adding or removing elements during iteration
+ *
+ * @param list pointer to list_chunk_sentinal_type
+ * @param var name for the pointer to the current entry inside callback
+ * @param callback code to be run on each iteration
+ */
+#define LIST_CHUNK_FOR_EACH(list, var, callback)                               \
+  do {                                                                         \
+    typeof((list)->head) __list_chunk = (list)->head;                          \
+    while (__list_chunk) {                                                     \
+      typeof(&__list_chunk->entries[0]) var =                                  \
+          &__list_chunk->entries[__list_chunk->start];                         \
+      typeof(var) __list_chunk_end = var + __list_chunk->count;                \
+      for (; var < __list_chunk_end; var++) {                                  \
+        callback;                                                              \
+      }                                                                        \
+      __list_chunk = __list_chunk->next;                                       \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Unrolled list reverse iterator
+ *
+ * Iterates from tail to head
+ * Does not allows adding or removing elements during iteration
+ *
+ * @param list pointer to list_chunk_sentinal_type
+ * @param var name for the pointer to the current entry inside callback
+ * @param callback code to be run on each iteration
+ */
+#define LIST_CHUNK_FOR_EACH_REV(list, var, callback)                           \
+  do {                                                                         \
+    typeof((list)->tail) __list_chunk = (list)->tail;                          \
+    while (__list_chunk) {                                                     \
+      typeof(&__list_chunk->entries[0]) __list_chunk_begin =                   \
+          &__list_chunk->entries[__list_chunk->start];                         \
+      typeof(__list_chunk_begin) var =                                         \
+          __list_chunk_begin + __list_chunk->count;                            \
+      while (var-- > __list_chunk_begin) {                                     \
+        callback;                                                              \
+      }                                                                        \
+      __list_chunk = __list_chunk->prev;                                       \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Runs a span kernel over every chunk of an unrolled list
+ *
+ * For internal use only
+ */
+#define _LIST_CHUNK_KERNEL(list, kernel, ...)                                  \
+  do {                                                                         \
+    for (typeof((list)->head) __list_chunk = (list)->head; __list_chunk;       \
+         __list_chunk = __list_chunk->next)                                    \
+      kernel(__list_chunk->entries + __list_chunk->start, __list_chunk->count, \
+             , __VA_ARGS__);                                                   \
+  } while (0)
+
+/**
+ * Finds the first element equal to key in an unrolled list
+ *
+ * The entry arrays of the chunks are compared a block at a time in loops the
+ * compiler can vectorize. Needs a type comparable with ==.
+ *
+ * @return pointer to the first matching element, NULL if there is none
+ *
+ * @param list pointer to list_chunk_sentinal_type to search
+ * @param key value to compare the elements with
+ */
+#define LIST_CHUNK_FIND_EQ(list, key)                                          \
+  ({                                                                           \
+    typeof((list)->head->entries[0]) __list_key = (key);                       \
+    typeof(&(list)->head->entries[0]) __list_found = NULL;                     \
+    for (typeof((list)->head) __list_chunk = (list)->head;                     \
+         __list_chunk && !__list_found; __list_chunk = __list_chunk->next)     \
+      _LIST_SPAN_FIND(__list_chunk->entries + __list_chunk->start,             \
+                      __list_chunk->count, , __list_key, __list_found);        \
+    __list_found;                                                              \
+  })
+
+/**
+ * Counts the elements of an unrolled list matching a predicate
+ *
+ * @return size_t number of elements for which predicate is nonzero
+ *
+ * @param list pointer to list_chunk_sentinal_type to scan
+ * @param var name for the element value to be used inside predicate
+ * @param predicate expression evaluated for every element, must not have side
+ * effects so that it can be vectorized
+ */
+#define LIST_CHUNK_COUNT_IF(list, var, predicate)                              \
+  ({                                                                           \
+    size_t __list_count = 0;                                                   \
+    _LIST_CHUNK_KERNEL(list, _LIST_SPAN_COUNT_IF, var, predicate,              \
+                       __list_count);                                          \
+    __list_count;                                                              \
+  })
+
+/**
+ * Sums the elements of an unrolled list
+ *
+ * @return sum of the elements, of the type of init
+ *
+ * @param list pointer to list_chunk_sentinal_type to sum
+ * @param init starting value, its type is used to accumulate (e.g. 0L to sum
+ * ints without overflow)
+ */
+#define LIST_CHUNK_SUM(list, init)                                             \
+  ({                                                                           \
+    typeof(init) __list_acc = (init);                                          \
+    _LIST_CHUNK_KERNEL(list, _LIST_SPAN_SUM, __list_acc);                      \
+    __list_acc;                                                                \
+  })
+
+/**
+ * Smallest element of a non empty unrolled list
+ *
+ * @return smallest element, compared with <
+ *
+ * @param list pointer to list_chunk_sentinal_type to scan, must not be empty
+ */
+#define LIST_CHUNK_MIN(list)                                                   \
+  ({                                                                           \
+    typeof((list)->head->entries[0]) __list_acc =                              \
+        (list)->head->entries[(list)->head->start];                            \
+    _LIST_CHUNK_KERNEL(list, _LIST_SPAN_MIN, __list_acc);                      \
+    __list_acc;                                                                \
+  })
+
+/**
+ * Largest element of a non empty unrolled list
+ *
+ * @return largest element, compared with >
+ *
+ * @param list pointer to list_chunk_sentinal_type to scan, must not be empty
+ */
+#define LIST_CHUNK_MAX(list)                                                   \
+  ({                                                                           \
+    typeof((list)->head->entries[0]) __list_acc =                              \
+        (list)->head->entries[(list)->head->start];                            \
+    _LIST_CHUNK_KERNEL(list, _LIST_SPAN_MAX, __list_acc);                      \
+    __list_acc;                                                                \
+  })
+
+/**
+ * Reports the memory used by an unrolled list
+ *
+ * Walks every chunk. Free room in the chunks counts as slack.
+ *
+ * @return struct list_memory, see there
+ *
+ * @param list pointer to list_chunk_sentinal_type
+ */
+#define LIST_CHUNK_MEMORY_USAGE(list)                                          \
+  ({                                                                           \
+    struct list_memory __list_mem = {0};                                       \
+    size_t __list_chunks = 0;                                                  \
+    for (typeof((list)->head) __list_chunk = (list)->head; __list_chunk;       \
+         __list_chunk = __list_chunk->next)                                    \
+      __list_chunks++;                                                         \
+    __list_mem.payload = (list)->length * sizeof((list)->head->entries[0]);    \
+    __list_mem.links =                                                         \
+        __list_chunks *                                                        \
+            (sizeof(*(list)->head) - sizeof((list)->head->entries)) +          \
+        sizeof(*(list));                                                       \
+    __list_mem.slack =                                                         \
+        __list_chunks * sizeof((list)->head->entries) - __list_mem.payload;    \
+    __list_mem.allocator =                                                     \
+        __list_chunks *                                                        \
+        list_allocator_overhead((list)->allocator, sizeof(*(list)->head));     \
+    __list_mem;                                                                \
+  })
+
+/**
+ * Unrolled list destructor
+ *
+ * Calls the destructor on every entry and frees all chunks
+ *
+ * @param list pointer to list_chunk_sentinal_type to be destroyed
+ */
+#define LIST_CHUNK_DESTROY(list)                                               \
+  do {                                                                         \
+    typeof((list)->head) __list_chunk = (list)->head;                          \
+    while (__list_chunk) {                                                     \
+      typeof(__list_chunk) __list_chunk_next = __list_chunk->next;             \
+      if ((list)->destructor)                                                  \
+        for (unsigned int __i = 0; __i < __list_chunk->count; __i++)           \
+          (list)->destructor(__list_chunk->entries[__list_chunk->start + __i]);\
+      _LIST_FREE(list, __list_chunk, sizeof(*__list_chunk));                   \
+      __list_chunk = __list_chunk_next;                                        \
+    }                                                                          \
+    (list)->head = (list)->tail = NULL;                                        \
+    (list)->length = 0;                                                        \
+  } while (0)
+
+/**
+ * Unrolled list constructor
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ */
+#define new_chunk_list(T, d)                                                   \
+  ({                                                                           \
+    struct list_chunk_sentinal_##T __new_list_data = {0};                      \
+    __new_list_data.destructor = d;                                            \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * Unrolled list constructor with a custom chunk allocator
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ * @param a pointer to struct list_allocator used for every chunk of the list
+ */
+#define new_chunk_list_alloc(T, d, a)                                          \
+  ({                                                                           \
+    struct list_chunk_sentinal_##T __new_list_data = new_chunk_list(T, d);     \
+    __new_list_data.allocator = a;                                             \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * Multi producer single consumer queue
+ *
+ * Any number of threads may append to a list_mpsc_TYPE concurrently without
+ * locks, while a single consumer thread pops from the front or takes every
+ * queued element at once as an ordinary list_sentinal_TYPE. Elements from
+ * one producer are consumed in the order that producer appended them.
+ *
+ * Producers push onto a lock-free stack. When the consumer runs out of ready
+ * elements it detaches the whole stack with one atomic exchange and reverses
+ * it onto ready, linking prev pointers on the way. Nodes are always allocated
+ * with malloc.
+ *
+ * e.g.
+ *
+ * ```
+ * struct list_mpsc_int queue = new_mpsc_list(int, NULL);
+ * // any thread
+ * LIST_MPSC_APPEND(&queue, 5);
+ * // consumer thread
+ * int elem;
+ * while (LIST_MPSC_POPF(&queue, &elem))
+ *   printf("%d\n", elem);
+ * ```
+ *
+ * @param T type parameter for list
+ */
+#define LIST_MPSC_DEFN(T)                                                      \
+  struct list_mpsc_##T {                                                       \
+    struct list_##T *pushed; /* Producer stack, newest first, atomic */        \
+    size_t length;           /* Elements in pushed and ready, atomic */        \
+    struct list_sentinal_##T ready; /* Owned by the consumer */                \
+  };
+EXPAND(LIST_MPSC_DEFN, TYPE)
+#undef LIST_MPSC_DEFN
+
+/**
+ * Append an element to a multi producer queue
+ *
+ * Safe to call from any number of threads at once.
+ *
+ * @return size_t length of the queue right after the append
+ *
+ * @param queue pointer to list_mpsc_type
+ * @param elem element of the same type as the list to append
+ */
+#define LIST_MPSC_APPEND(queue, elem)                                          \
+  ({                                                                           \
+    typeof((queue)->pushed) __list_node = malloc(sizeof(*__list_node));        \
+    __list_node->entry = elem;                                                 \
+    __list_node->prev = NULL;                                                  \
+    __list_node->slab = NULL;                                                  \
+    /* Count first so the consumer never sees length underflow */              \
+    size_t __list_length =                                                     \
+        __atomic_add_fetch(&(queue)->length, 1, __ATOMIC_RELAXED);             \
+    __list_node->next = __atomic_load_n(&(queue)->pushed, __ATOMIC_RELAXED);   \
+    while (!__atomic_compare_exchange_n(&(queue)->pushed, &__list_node->next,  \
+                                        __list_node, 1, __ATOMIC_RELEASE,      \
+                                        __ATOMIC_RELAXED))                     \
+      ;                                                                        \
+    __list_length;                                                             \
+  })
+
+/**
+ * Moves everything producers pushed so far to the tail of ready
+ *
+ * For internal use only - consumer side
+ */
+#define _LIST_MPSC_REFILL(queue)                                               \
+  ({                                                                           \
+    typeof((queue)->pushed) __list_node =                                      \
+        __atomic_exchange_n(&(queue)->pushed, NULL, __ATOMIC_ACQUIRE);         \
+    typeof(__list_node) __list_chain = NULL;                                   \
+    typeof(__list_node) __list_chain_tail = __list_node;                       \
+    size_t __list_count = 0;                                                   \
+    while (__list_node) {                                                      \
+      typeof(__list_node) __list_older = __list_node->next;                    \
+      __list_node->next = __list_chain;                                        \
+      if (__list_chain)                                                        \
+        __list_chain->prev = __list_node;                                      \
+      __list_chain = __list_node;                                              \
+      __list_node = __list_older;                                              \
+      __list_count++;                                                          \
+    }                                                                          \
+    if (__list_chain) {                                                        \
+      __list_chain->prev = (queue)->ready.tail;                                \
+      if ((queue)->ready.tail)                                                 \
+        (queue)->ready.tail->next = __list_chain;                              \
+      else                                                                     \
+        (queue)->ready.head = __list_chain;                                    \
+      (queue)->ready.tail = __list_chain_tail;                                 \
+      (queue)->ready.length += __list_count;                                   \
+    }                                                                          \
+    __list_count;                                                              \
+  })
+
+/**
+ * Pop from the front of a multi producer queue
+ *
+ * Must only be called from the consumer thread.
+ *
+ * @return 0 if the queue was empty, 1 if an element was stored in out
+ *
+ * @param queue pointer to list_mpsc_type
+ * @param out pointer to an element of the list's type receiving the value
+ */
+#define LIST_MPSC_POPF(queue, out)                                             \
+  ({                                                                           \
+    if (!(queue)->ready.head)                                                  \
+      _LIST_MPSC_REFILL(queue);                                                \
+    int __list_popped = (queue)->ready.head != NULL;                           \
+    if (__list_popped) {                                                       \
+      *(out) = LIST_POPF(&(queue)->ready);                                     \
+      __atomic_sub_fetch(&(queue)->length, 1, __ATOMIC_RELAXED);               \
+    }                                                                          \
+    __list_popped;                                                             \
+  })
+
+/**
+ * Takes every element currently in a multi producer queue
+ *
+ * Must only be called from the consumer thread.
+ *
+ * @return list_sentinal_type holding the elements in queue order, ownership
+ * passes to the caller
+ *
+ * @param queue pointer to list_mpsc_type
+ */
+#define LIST_MPSC_TAKE(queue)                                                  \
+  ({                                                                           \
+    _LIST_MPSC_REFILL(queue);                                                  \
+    typeof((queue)->ready) __list_batch = (queue)->ready;                      \
+    (queue)->ready.head = (queue)->ready.tail = NULL;                          \
+    (queue)->ready.length = 0;                                                 \
+    (queue)->ready.finger = NULL;                                              \
+    __atomic_sub_fetch(&(queue)->length, __list_batch.length,                  \
+                       __ATOMIC_RELAXED);                                      \
+    __list_batch;                                                              \
+  })
+
+/**
+ * Number of elements in a multi producer queue
+ *
+ * @param queue pointer to list_mpsc_type
+ */
+#define LIST_MPSC_LENGTH(queue)                                                \
+  __atomic_load_n(&(queue)->length, __ATOMIC_RELAXED)
+
+/**
+ * Multi producer queue destructor
+ *
+ * Must only be called once no producer can append anymore.
+ *
+ * @param queue pointer to list_mpsc_type to be destroyed
+ */
+#define LIST_MPSC_DESTROY(queue)                                               \
+  do {                                                                         \
+    _LIST_MPSC_REFILL(queue);                                                  \
+    LIST_DESTROY(&(queue)->ready);                                             \
+    (queue)->length = 0;                                                       \
+  } while (0)
+
+/**
+ * Multi producer queue constructor
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ */
+#define new_mpsc_list(T, d)                                                    \
+  ({                                                                           \
+    struct list_mpsc_##T __new_list_data = {0};                                \
+    _LIST_SET_DESTRUCTOR(&__new_list_data.ready, d);                           \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * Read mostly concurrent list
+ *
+ * list_rcu_TYPE lets any number of threads traverse the list without locks
+ * while it is being changed. Writers publish every pointer a reader follows
+ * with release stores and readers load them with acquire, so a reader sees
+ * each node fully initialized. Deleted nodes are unlinked but not freed:
+ * they are retired and freed, after the destructor runs on them, once the
+ * list's struct list_epoch shows that no reader can still reach them.
+ *
+ * Readers traverse head to tail only, between LIST_RCU_READ_LOCK and
+ * LIST_RCU_READ_UNLOCK on their own reader slot, and must not keep node
+ * pointers past the unlock. Writers must be serialized by the caller, e.g.
+ * with a mutex. Retired nodes are grouped by the epoch they were retired in,
+ * in one of _LIST_RCU_BUCKETS buckets, and each bucket is freed once every
+ * reader that entered before its epoch has left. Deletes go into the open
+ * bucket until the next one has been freed, so readers that keep overlapping
+ * only hold back the nodes retired while the oldest of them was reading.
+ *
+ * e.g.
+ *
+ * ```
+ * struct list_epoch epoch;
+ * list_epoch_init(&epoch, nthreads);
+ * struct list_rcu_int routes = new_rcu_list(int, NULL, &epoch);
+ *
+ * // reader thread number id
+ * LIST_RCU_READ_LOCK(&routes, id);
+ * LIST_RCU_FOR_EACH(&routes, route, { lookup(route->entry); });
+ * LIST_RCU_READ_UNLOCK(&routes, id);
+ *
+ * // writer, holding the writers' mutex
+ * LIST_RCU_DEL(&routes, stale);
+ * ```
+ *
+ * @param T type parameter for list
+ */
+#define LIST_RCU_DEFN(T)                                                       \
+  struct list_rcu_##T {                                                        \
+    struct list_##T *head; /* Read with acquire by readers */                  \
+    struct list_##T *tail; /* Writer only */                                   \
+    size_t length;         /* Atomic */                                        \
+    list_destructor_##T destructor;                                            \
+    struct list_epoch *epoch;                                                  \
+    /* Unlinked nodes, chained through prev, by retirement epoch */            \
+    struct list_##T *retired[_LIST_RCU_BUCKETS];                               \
+    unsigned long retired_epoch[_LIST_RCU_BUCKETS]; /* Latest unlink */        \
+    size_t retired_open; /* Bucket deletes go into */                          \
+    size_t retired_length;                                                     \
+  };
+EXPAND(LIST_RCU_DEFN, TYPE)
+#undef LIST_RCU_DEFN
+
+/**
+ * Starts a read side traversal
+ *
+ * @param list pointer to list_rcu_type to be read
+ * @param slot index of the calling thread's reader slot in the list's epoch
+ */
+#define LIST_RCU_READ_LOCK(list, slot) list_epoch_enter((list)->epoch, slot)
+
+/**
+ * Ends a read side traversal
+ *
+ * @param list pointer to list_rcu_type that was read
+ * @param slot index of the calling thread's reader slot in the list's epoch
+ */
+#define LIST_RCU_READ_UNLOCK(list, slot) list_epoch_exit((list)->epoch, slot)
+
+/**
+ * Lock free list iterator
+ *
+ * Iterates from head to tail. Readers must hold LIST_RCU_READ_LOCK; elements
+ * added or deleted concurrently may or may not be visited.
+ *
+ * @param list pointer to list_rcu_type
+ * @param var name for the list_type pointer to be used inside callback
+ * @param callback code to be run on each iteration, must not modify entries
+ */
+#define LIST_RCU_FOR_EACH(list, var, callback)                                 \
+  do {                                                                         \
+    typeof((list)->head) var =                                                 \
+        __atomic_load_n(&(list)->head, __ATOMIC_ACQUIRE);                      \
+    while (var) {                                                              \
+      callback;                                                                \
+      var = __atomic_load_n(&var->next, __ATOMIC_ACQUIRE);                     \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Append an element to the tail of a concurrent list
+ *
+ * Writer side, see list_rcu_TYPE.
+ *
+ * @return size_t length of the list after the append
+ *
+ * @param list pointer to list_rcu_type
+ * @param elem element of the same type as the list to append
+ */
+#define LIST_RCU_APPEND(list, elem)                                            \
+  ({                                                                           \
+    typeof((list)->head) __list_node = malloc(sizeof(*__list_node));           \
+    __list_node->entry = elem;                                                 \
+    __list_node->next = NULL;                                                  \
+    __list_node->prev = (list)->tail;                                          \
+    if ((list)->tail)                                                          \
+      __atomic_store_n(&(list)->tail->next, __list_node, __ATOMIC_RELEASE);    \
+    else                                                                       \
+      __atomic_store_n(&(list)->head, __list_node, __ATOMIC_RELEASE);          \
+    (list)->tail = __list_node;                                                \
+    __atomic_add_fetch(&(list)->length, 1, __ATOMIC_RELAXED);                  \
+  })
+
+/**
+ * Prepend an element to the head of a concurrent list
+ *
+ * Writer side, see list_rcu_TYPE.
+ *
+ * @return size_t length of the list after the prepend
+ *
+ * @param list pointer to list_rcu_type
+ * @param elem element of the same type as the list to prepend
+ */
+#define LIST_RCU_PREPEND(list, elem)                                           \
+  ({                                                                           \
+    typeof((list)->head) __list_node = malloc(sizeof(*__list_node));           \
+    __list_node->entry = elem;                                                 \
+    __list_node->prev = NULL;                                                  \
+    __list_node->next = (list)->head;                                          \
+    if ((list)->head)                                                          \
+      (list)->head->prev = __list_node;                                        \
+    else                                                                       \
+      (list)->tail = __list_node;                                              \
+    __atomic_store_n(&(list)->head, __list_node, __ATOMIC_RELEASE);            \
+    __atomic_add_fetch(&(list)->length, 1, __ATOMIC_RELAXED);                  \
+  })
+
+/**
+ * Frees every node of a bucket of retired nodes
+ *
+ * For internal use only - see LIST_RCU_RECLAIM and LIST_RCU_DESTROY
+ */
+#define _LIST_RCU_FREE_BUCKET(list, bucket)                                    \
+  ({                                                                           \
+    size_t __list_freed = 0;                                                   \
+    while ((list)->retired[bucket]) {                                          \
+      typeof((list)->head) __list_node = (list)->retired[bucket];              \
+      (list)->retired[bucket] = __list_node->prev;                             \
+      if ((list)->destructor)                                                  \
+        (list)->destructor(__list_node->entry);                                \
+      free(__list_node);                                                       \
+      __list_freed++;                                                          \
+    }                                                                          \
+    (list)->retired_length -= __list_freed;                                    \
+    __list_freed;                                                              \
+  })
+
+/**
+ * Frees retired nodes if no reader can still reach them
+ *
+ * Writer side. LIST_RCU_DEL calls this after every delete, call it directly
+ * to free nodes retired while readers were busy. Once the bucket after the
+ * open one is empty, the open bucket is closed and stops taking deletes, so
+ * its epoch no longer moves.
+ *
+ * @return size_t number of nodes freed
+ *
+ * @param list pointer to list_rcu_type
+ */
+#define LIST_RCU_RECLAIM(list)                                                 \
+  ({                                                                           \
+    size_t __list_reclaimed = 0;                                               \
+    for (size_t __list_b = 0; __list_b < _LIST_RCU_BUCKETS; __list_b++)        \
+      if ((list)->retired[__list_b] &&                                         \
+          list_epoch_safe((list)->epoch, (list)->retired_epoch[__list_b]))     \
+        __list_reclaimed += _LIST_RCU_FREE_BUCKET(list, __list_b);             \
+    size_t __list_next = ((list)->retired_open + 1) % _LIST_RCU_BUCKETS;       \
+    if ((list)->retired[(list)->retired_open] &&                               \
+        !(list)->retired[__list_next])                                         \
+      (list)->retired_open = __list_next;                                      \
+    __list_reclaimed;                                                          \
+  })
+
+/**
+ * Deletes an element from a concurrent list
+ *
+ * Writer side. The node is unlinked at once and freed, after the destructor
+ * runs on it, once no reader can reach it anymore. Readers already on the
+ * node still see its entry and can move on from it.
+ *
+ * @param list pointer to list_rcu_type
+ * @param elem pointer to list_type of element to delete
+ */
+#define LIST_RCU_DEL(list, elem)                                               \
+  ({                                                                           \
+    typeof((list)->head) __list_del = (elem);                                  \
+    if (__list_del->prev)                                                      \
+      __atomic_store_n(&__list_del->prev->next, __list_del->next,              \
+                       __ATOMIC_RELEASE);                                      \
+    else                                                                       \
+      __atomic_store_n(&(list)->head, __list_del->next, __ATOMIC_RELEASE);     \
+    if (__list_del->next)                                                      \
+      __list_del->next->prev = __list_del->prev;                               \
+    else                                                                       \
+      (list)->tail = __list_del->prev;                                         \
+    __atomic_sub_fetch(&(list)->length, 1, __ATOMIC_RELAXED);                  \
+    /* Readers never follow prev, so it links the retired nodes */             \
+    __list_del->prev = (list)->retired[(list)->retired_open];                  \
+    (list)->retired[(list)->retired_open] = __list_del;                        \
+    (list)->retired_length++;                                                  \
+    (list)->retired_epoch[(list)->retired_open] =                              \
+        list_epoch_advance((list)->epoch);                                     \
+    LIST_RCU_RECLAIM(list);                                                    \
+  })
+
+/**
+ * Number of elements in a concurrent list
+ *
+ * @param list pointer to list_rcu_type
+ */
+#define LIST_RCU_LENGTH(list) __atomic_load_n(&(list)->length, __ATOMIC_RELAXED)
+
+/**
+ * Concurrent list destructor
+ *
+ * Must only be called once no reader or writer uses the list anymore. Calls
+ * the destructor on every element, live or retired, and frees every node.
+ *
+ * @param list pointer to list_rcu_type to be destroyed
+ */
+#define LIST_RCU_DESTROY(list)                                                 \
+  do {                                                                         \
+    while ((list)->head) {                                                     \
+      typeof((list)->head) __list_node = (list)->head;                         \
+      (list)->head = __list_node->next;                                        \
+      if ((list)->destructor)                                                  \
+        (list)->destructor(__list_node->entry);                                \
+      free(__list_node);                                                       \
+    }                                                                          \
+    for (size_t __list_b = 0; __list_b < _LIST_RCU_BUCKETS; __list_b++)        \
+      _LIST_RCU_FREE_BUCKET(list, __list_b);                                   \
+    (list)->tail = NULL;                                                       \
+    (list)->length = 0;                                                        \
+  } while (0)
+
+/**
+ * Concurrent list constructor
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ * @param e pointer to the struct list_epoch readers of the list use
+ */
+#define new_rcu_list(T, d, e)                                                  \
+  ({                                                                           \
+    struct list_rcu_##T __new_list_data = {0};                                 \
+    __new_list_data.destructor = d;                                            \
+    __new_list_data.epoch = e;                                                 \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * Array backed deque
+ *
+ * deque_TYPE is a growable circular buffer with the same interface as
+ * list_sentinal_TYPE for the operations a deque supports: DEQUE_APPEND,
+ * DEQUE_PREPEND, DEQUE_POPF, DEQUE_POPB, DEQUE_AT, the iterators and
+ * DEQUE_DESTROY mirror their LIST_ counterparts, including the destructor
+ * and length fields. Iterators hand out pointers to struct deque_entry_TYPE,
+ * whose only member is entry, so callbacks written for LIST_FOR_EACH work
+ * unchanged. Code that sticks to these operations can switch containers by
+ * changing the sentinal type and the macro prefix.
+ *
+ * Pointers to entries are invalidated whenever the deque grows.
+ *
+ * @param T type parameter for list
+ */
+#define DEQUE_DEFN(T)                                                          \
+  struct deque_entry_##T {                                                     \
+    T entry;                                                                   \
+  };                                                                           \
+  struct deque_##T {                                                           \
+    struct deque_entry_##T *buffer;                                            \
+    size_t capacity; /* Power of two, 0 until the first insert */              \
+    size_t start;    /* Index in buffer of the head */                         \
+    size_t length;                                                             \
+    list_destructor_##T destructor;                                            \
+    struct list_allocator *allocator; /* NULL to use malloc/free */            \
+  };
+EXPAND(DEQUE_DEFN, TYPE)
+#undef DEQUE_DEFN
+
+/**
+ * Returns the buffer slot of position i
+ *
+ * For internal use only
+ */
+#define _DEQUE_SLOT(deque, i)                                                  \
+  (&(deque)->buffer[((deque)->start + (i)) & ((deque)->capacity - 1)])
+
+/**
+ * Makes room for n more elements
+ *
+ * For internal use only - the buffer is doubled until it fits and the
+ * elements are moved to the start of the new buffer, in order.
+ */
+#define _DEQUE_RESERVE(deque, n)                                               \
+  ({                                                                           \
+    size_t __deque_needed = (deque)->length + (n);                             \
+    if (__deque_needed > (deque)->capacity) {                                  \
+      size_t __deque_capacity = (deque)->capacity ? (deque)->capacity : 16;    \
+      while (__deque_capacity < __deque_needed)                                \
+        __deque_capacity *= 2;                                                 \
+      typeof((deque)->buffer) __deque_buffer =                                 \
+          _LIST_ALLOC(deque, __deque_capacity * sizeof(*__deque_buffer));      \
+      if ((deque)->capacity) {                                                 \
+        size_t __deque_first = (deque)->capacity - (deque)->start;             \
+        if (__deque_first > (deque)->length)                                   \
+          __deque_first = (deque)->length;                                     \
+        memcpy(__deque_buffer, (deque)->buffer + (deque)->start,               \
+               __deque_first * sizeof(*__deque_buffer));                       \
+        memcpy(__deque_buffer + __deque_first, (deque)->buffer,                \
+               ((deque)->length - __deque_first) * sizeof(*__deque_buffer));   \
+        _LIST_FREE(deque, (deque)->buffer,                                     \
+                   (deque)->capacity * sizeof(*__deque_buffer));               \
+      }                                                                        \
+      (deque)->buffer = __deque_buffer;                                        \
+      (deque)->capacity = __deque_capacity;                                    \
+      (deque)->start = 0;                                                      \
+    }                                                                          \
+  })
+
+/**
+ * Append an element to the tail of the deque
+ *
+ * @return size_t length of new deque
+ *
+ * @param deque pointer to deque_type
+ * @param elem element of the same type as the deque to append
+ */
+#define DEQUE_APPEND(deque, elem)                                              \
+  ({                                                                           \
+    _DEQUE_RESERVE(deque, 1);                                                  \
+    _DEQUE_SLOT(deque, (deque)->length)->entry = elem;                         \
+    ++(deque)->length;                                                         \
+  })
+
+/**
+ * Prepend an element to the head of the deque
+ *
+ * @return size_t length of new deque
+ *
+ * @param deque pointer to deque_type
+ * @param elem element of the same type as the deque to prepend
+ */
+#define DEQUE_PREPEND(deque, elem)                                             \
+  ({                                                                           \
+    _DEQUE_RESERVE(deque, 1);                                                  \
+    (deque)->start = ((deque)->start - 1) & ((deque)->capacity - 1);           \
+    (deque)->buffer[(deque)->start].entry = elem;                              \
+    ++(deque)->length;                                                         \
+  })
+
+/**
+ * Append an array to a deque, growing the buffer at most once
+ *
+ * @return pointer to the deque passed in
+ *
+ * @param deque pointer to deque_type
+ * @param array elements to append
+ * @param len length of array
+ */
+#define DEQUE_APPEND_ARRAY(deque, array, len)                                  \
+  ({                                                                           \
+    size_t __deque_len = (len);                                                \
+    _DEQUE_RESERVE(deque, __deque_len);                                        \
+    for (size_t __i = 0; __i < __deque_len; __i++)                             \
+      _DEQUE_SLOT(deque, (deque)->length + __i)->entry = (array)[__i];         \
+    (deque)->length += __deque_len;                                            \
+    deque;                                                                     \
+  })
+
+/**
+ * Deque pop from front
+ *
+ * @return element at head of deque
+ *
+ * @param deque pointer to deque_type
+ */
+#define DEQUE_POPF(deque)                                                      \
+  ({                                                                           \
+    typeof((deque)->buffer->entry) __deque_retval =                            \
+        (deque)->buffer[(deque)->start].entry;                                 \
+    (deque)->start = ((deque)->start + 1) & ((deque)->capacity - 1);           \
+    (deque)->length--;                                                         \
+    __deque_retval;                                                            \
+  })
+
+/**
+ * Deque pop from back
+ *
+ * @return element at tail of deque
+ *
+ * @param deque pointer to deque_type
+ */
+#define DEQUE_POPB(deque)                                                      \
+  ({                                                                           \
+    (deque)->length--;                                                         \
+    _DEQUE_SLOT(deque, (deque)->length)->entry;                                \
+  })
+
+/**
+ * Returns the element at position i
+ *
+ * @return pointer to deque_entry_type at position i, NULL if i is out of range
+ *
+ * @param deque pointer to deque_type
+ * @param i zero based position of the element
+ */
+#define DEQUE_AT(deque, i)                                                     \
+  ({                                                                           \
+    size_t __deque_i = (i);                                                    \
+    __deque_i < (deque)->length ? _DEQUE_SLOT(deque, __deque_i) : NULL;        \
+  })
+
+/**
+ * Generic deque iterator
+ *
+ * For internal use only - see DEQUE_FOR_EACH and DEQUE_FOR_EACH_REV
+ */
+#define _DEQUE_FOR_EACH(deque, var, position, callback)                        \
+  do {                                                                         \
+    for (size_t __deque_i = 0; __deque_i < (deque)->length; __deque_i++) {     \
+      typeof((deque)->buffer) var = _DEQUE_SLOT(deque, position);              \
+      callback;                                                                \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Deque iterator
+ *
+ * Iterates from head to tail
+ * Does not allow adding or removing elements during iteration
+ *
+ * @param deque pointer to deque_type
+ * @param var name for the deque_entry_type pointer used inside callback
+ * @param callback code to be run on each iteration
+ */
+#define DEQUE_FOR_EACH(deque, var, callback)                                   \
+  _DEQUE_FOR_EACH(deque, var, __deque_i, callback)
+
+/**
+ * Deque reverse iterator
+ *
+ * Iterates from tail to head
+ * Does not allow adding or removing elements during iteration
+ *
+ * @param deque pointer to deque_type
+ * @param var name for the deque_entry_type pointer used inside callback
+ * @param callback code to be run on each iteration
+ */
+#define DEQUE_FOR_EACH_REV(deque, var, callback)                               \
+  _DEQUE_FOR_EACH(deque, var, (deque)->length - 1 - __deque_i, callback)
+
+/**
+ * Parallel deque iterator
+ *
+ * Same as LIST_PARALLEL_FOR_EACH, except that no walk is needed to find the
+ * ranges since every element can be addressed directly.
+ *
+ * @param deque pointer to deque_type
+ * @param var name for the deque_entry_type pointer used inside callback
+ * @param nthreads number of threads to split the deque across, at most 256
+ * @param callback code to be run on each iteration
+ */
+#define DEQUE_PARALLEL_FOR_EACH(deque, var, nthreads, callback)                \
+  do {                                                                         \
+    size_t __deque_nthreads = (nthreads);                                      \
+    if (__deque_nthreads > _LIST_PARALLEL_MAX_THREADS)                         \
+      __deque_nthreads = _LIST_PARALLEL_MAX_THREADS;                           \
+    if (!__deque_nthreads)                                                     \
+      __deque_nthreads = 1;                                                    \
+    _LIST_PARALLEL_FOR(__deque_nthreads)                                       \
+    for (size_t __deque_i = 0; __deque_i < (deque)->length; __deque_i++) {     \
+      typeof((deque)->buffer) var = _DEQUE_SLOT(deque, __deque_i);             \
+      callback;                                                                \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Runs a span kernel over the one or two contiguous runs of a deque
+ *
+ * For internal use only
+ */
+#define _DEQUE_KERNEL(deque, kernel, ...)                                      \
+  do {                                                                         \
+    size_t __deque_first = (deque)->capacity - (deque)->start;                 \
+    if (__deque_first > (deque)->length)                                       \
+      __deque_first = (deque)->length;                                         \
+    if ((deque)->length)                                                       \
+      kernel((deque)->buffer + (deque)->start, __deque_first, .entry,          \
+             __VA_ARGS__);                                                     \
+    if ((deque)->length > __deque_first)                                       \
+      kernel((deque)->buffer, (deque)->length - __deque_first, .entry,         \
+             __VA_ARGS__);                                                     \
+  } while (0)
+
+/**
+ * Finds the first element equal to key in a deque
+ *
+ * See LIST_CHUNK_FIND_EQ
+ *
+ * @return pointer to the first matching element, NULL if there is none
+ *
+ * @param deque pointer to deque_type to search
+ * @param key value to compare the elements with
+ */
+#define DEQUE_FIND_EQ(deque, key)                                              \
+  ({                                                                           \
+    typeof((deque)->buffer->entry) __deque_key = (key);                        \
+    typeof(&(deque)->buffer->entry) __deque_found = NULL;                      \
+    _DEQUE_KERNEL(deque, _LIST_SPAN_FIND, __deque_key, __deque_found);         \
+    __deque_found;                                                             \
+  })
+
+/**
+ * Counts the elements of a deque matching a predicate
+ *
+ * See LIST_CHUNK_COUNT_IF
+ *
+ * @return size_t number of elements for which predicate is nonzero
+ *
+ * @param deque pointer to deque_type to scan
+ * @param var name for the element value to be used inside predicate
+ * @param predicate expression evaluated for every element
+ */
+#define DEQUE_COUNT_IF(deque, var, predicate)                                  \
+  ({                                                                           \
+    size_t __deque_count = 0;                                                  \
+    _DEQUE_KERNEL(deque, _LIST_SPAN_COUNT_IF, var, predicate, __deque_count);  \
+    __deque_count;                                                             \
+  })
+
+/**
+ * Sums the elements of a deque
+ *
+ * See LIST_CHUNK_SUM
+ *
+ * @return sum of the elements, of the type of init
+ *
+ * @param deque pointer to deque_type to sum
+ * @param init starting value, its type is used to accumulate
+ */
+#define DEQUE_SUM(deque, init)                                                 \
+  ({                                                                           \
+    typeof(init) __deque_acc = (init);                                         \
+    _DEQUE_KERNEL(deque, _LIST_SPAN_SUM, __deque_acc);                         \
+    __deque_acc;                                                               \
+  })
+
+/**
+ * Smallest element of a non empty deque
+ *
+ * @return smallest element, compared with <
+ *
+ * @param deque pointer to deque_type to scan, must not be empty
+ */
+#define DEQUE_MIN(deque)                                                       \
+  ({                                                                           \
+    typeof((deque)->buffer->entry) __deque_acc =                               \
+        (deque)->buffer[(deque)->start].entry;                                 \
+    _DEQUE_KERNEL(deque, _LIST_SPAN_MIN, __deque_acc);                         \
+    __deque_acc;                                                               \
+  })
+
+/**
+ * Largest element of a non empty deque
+ *
+ * @return largest element, compared with >
+ *
+ * @param deque pointer to deque_type to scan, must not be empty
+ */
+#define DEQUE_MAX(deque)                                                       \
+  ({                                                                           \
+    typeof((deque)->buffer->entry) __deque_acc =                               \
+        (deque)->buffer[(deque)->start].entry;                                 \
+    _DEQUE_KERNEL(deque, _LIST_SPAN_MAX, __deque_acc);                         \
+    __deque_acc;                                                               \
+  })
+
+/**
+ * Reports the memory used by a deque
+ *
+ * Free room in the buffer counts as slack.
+ *
+ * @return struct list_memory, see there
+ *
+ * @param deque pointer to deque_type
+ */
+#define DEQUE_MEMORY_USAGE(deque)                                              \
+  ({                                                                           \
+    struct list_memory __deque_mem = {0};                                      \
+    size_t __deque_bytes = (deque)->capacity * sizeof(*(deque)->buffer);       \
+    __deque_mem.payload = (deque)->length * sizeof(*(deque)->buffer);          \
+    __deque_mem.links = sizeof(*(deque));                                      \
+    __deque_mem.slack = __deque_bytes - __deque_mem.payload;                   \
+    if (__deque_bytes)                                                         \
+      __deque_mem.allocator =                                                  \
+          list_allocator_overhead((deque)->allocator, __deque_bytes);          \
+    __deque_mem;                                                               \
+  })
+
+/**
+ * Deque destructor
+ *
+ * Calls the destructor on every element and frees the buffer
+ *
+ * @param deque pointer to deque_type to be destroyed
+ */
+#define DEQUE_DESTROY(deque)                                                   \
+  do {                                                                         \
+    if ((deque)->destructor)                                                   \
+      DEQUE_FOR_EACH(deque, __deque_var,                                       \
+                     { (deque)->destructor(__deque_var->entry); });            \
+    if ((deque)->capacity)                                                     \
+      _LIST_FREE(deque, (deque)->buffer,                                       \
+                 (deque)->capacity * sizeof(*(deque)->buffer));                \
+    (deque)->buffer = NULL;                                                    \
+    (deque)->capacity = (deque)->start = (deque)->length = 0;                  \
+  } while (0)
+
+/**
+ * Deque constructor
+ *
+ * @param T type of deque to create
+ * @param d destructor for the deque
+ */
+#define new_deque(T, d)                                                        \
+  ({                                                                           \
+    struct deque_##T __new_list_data = {0};                                    \
     __new_list_data.destructor = d;                                            \
     __new_list_data;                                                           \
   })
+
+/**
+ * Deque constructor with a custom buffer allocator
+ *
+ * @param T type of deque to create
+ * @param d destructor for the deque
+ * @param a pointer to struct list_allocator used for the buffer
+ */
+#define new_deque_alloc(T, d, a)                                               \
+  ({                                                                           \
+    struct deque_##T __new_list_data = new_deque(T, d);                        \
+    __new_list_data.allocator = a;                                             \
+    __new_list_data;                                                           \
+  })
+#endif
+
+/**
+ * Per type functions
+ *
+ * Some variants need code that depends on parameters only visible while
+ * list.h is being included (e.g. KEY_OF), so they are generated as functions
+ * rather than macros, and the core operations are also available as
+ * functions to keep call sites small. Following _LIST_HEADER and
+ * _LIST_IMPLEMENTATION, the header only declares them, the implementation
+ * defines them, and a plain include defines them static inline.
+ */
+#if defined(_LIST_HEADER)
+#define _LIST_FN(decl, ...) decl;
+#elif defined(_LIST_IMPLEMENTATION)
+#define _LIST_FN(decl, ...) decl __VA_ARGS__
+#else
+#define _LIST_FN(decl, ...) static inline decl __VA_ARGS__
+#endif
+
+/**
+ * Defines out of line list functions
+ *
+ * Every LIST_ macro expands its whole body at each call site. Programs with
+ * many call sites can use these functions instead, which wrap the macros of
+ * the same name: with _LIST_HEADER and _LIST_IMPLEMENTATION they are
+ * compiled once, in the implementation file, and called everywhere else. The
+ * macros stay available, and inline, for hot paths.
+ *
+ * list_append_TYPE, list_prepend_TYPE, list_append_array_TYPE,
+ * list_prepend_array_TYPE, list_popf_TYPE, list_popb_TYPE, list_popf_n_TYPE,
+ * list_popb_n_TYPE, list_remove_TYPE, list_del_TYPE, list_at_TYPE,
+ * list_insert_at_TYPE, list_splice_TYPE, list_split_TYPE, list_compact_TYPE
+ * and list_destroy_TYPE take the same arguments as the macros, with the list
+ * always passed as a pointer. Since arguments are evaluated once,
+ * list_del_TYPE(&list, list.head) is safe where LIST_DEL(&list, list.head)
+ * is not.
+ *
+ * @param T type parameter for list
+ */
+#define LIST_FNS(T)                                                            \
+  _LIST_FN(size_t list_append_##T(struct list_sentinal_##T *list, T elem),     \
+           { return LIST_APPEND(list, elem); })                                \
+  _LIST_FN(size_t list_prepend_##T(struct list_sentinal_##T *list, T elem),    \
+           { return LIST_PREPEND(list, elem); })                               \
+  _LIST_FN(void list_append_array_##T(struct list_sentinal_##T *list,          \
+                                      const T *array, size_t len),             \
+           { LIST_APPEND_ARRAY(list, array, len); })                           \
+  _LIST_FN(void list_prepend_array_##T(struct list_sentinal_##T *list,         \
+                                       const T *array, size_t len),            \
+           { LIST_PREPEND_ARRAY(list, array, len); })                          \
+  _LIST_FN(T list_popf_##T(struct list_sentinal_##T *list),                    \
+           { return LIST_POPF(list); })                                        \
+  _LIST_FN(T list_popb_##T(struct list_sentinal_##T *list),                    \
+           { return LIST_POPB(list); })                                        \
+  _LIST_FN(size_t list_popf_n_##T(struct list_sentinal_##T *list, size_t n,    \
+                                  T *out),                                     \
+           { return LIST_POPF_N(list, n, out); })                              \
+  _LIST_FN(size_t list_popb_n_##T(struct list_sentinal_##T *list, size_t n,    \
+                                  T *out),                                     \
+           { return LIST_POPB_N(list, n, out); })                              \
+  _LIST_FN(void list_remove_##T(struct list_sentinal_##T *list,                \
+                                struct list_##T *node),                        \
+           { LIST_REMOVE(list, node); })                                       \
+  _LIST_FN(void list_del_##T(struct list_sentinal_##T *list,                   \
+                             struct list_##T *node),                           \
+           { LIST_DEL(list, node); })                                          \
+  _LIST_FN(struct list_##T *list_at_##T(struct list_sentinal_##T *list,        \
+                                        size_t i),                             \
+           { return LIST_AT(list, i); })                                       \
+  _LIST_FN(size_t list_insert_at_##T(struct list_sentinal_##T *list, size_t i, \
+                                     T elem),                                  \
+           { return LIST_INSERT_AT(list, i, elem); })                          \
+  _LIST_FN(size_t list_splice_##T(struct list_sentinal_##T *dst,               \
+                                  struct list_sentinal_##T *src),              \
+           { return LIST_SPLICE(dst, src); })                                  \
+  _LIST_FN(size_t list_split_##T(struct list_sentinal_##T *list,               \
+                                 struct list_##T *node,                        \
+                                 struct list_sentinal_##T *out),               \
+           { return LIST_SPLIT(list, node, out); })                            \
+  _LIST_FN(void list_compact_##T(struct list_sentinal_##T *list),              \
+           { LIST_COMPACT(list); })                                            \
+  _LIST_FN(void list_destroy_##T(struct list_sentinal_##T *list),              \
+           { LIST_DESTROY(list) })
+EXPAND(LIST_FNS, TYPE)
+#undef LIST_FNS
+
+/**
+ * Key indexed list
+ *
+ * Defining KEY_TYPE, KEY_OF and KEY_HASH next to TYPE additionally generates
+ * list_indexed_TYPE, a list_sentinal_TYPE paired with an open addressing hash
+ * table from key to node. Looking up or deleting an element by key is O(1).
+ *
+ * KEY_TYPE type of the keys
+ * KEY_OF(entry) expression giving the key of an entry
+ * KEY_HASH(key) expression giving a size_t hash of a key
+ * KEY_EQ(a, b) (optional) true if two keys are equal, defaults to ==
+ *
+ * The list member can be read with every list macro, but elements must only
+ * be added and removed through the LIST_INDEXED_* macros below so the table
+ * stays in sync. Keys are unique: adding an element whose key is already
+ * present fails.
+ *
+ * e.g.
+ *
+ * ```
+ * #define TYPE int
+ * #define KEY_TYPE int
+ * #define KEY_OF(entry) (entry)
+ * #define KEY_HASH(key) ((size_t)(key) * 0x9E3779B97F4A7C15ull)
+ * #include "list.h"
+ * ...
+ *
+ * struct list_indexed_int set = new_indexed_list(int, NULL);
+ * LIST_INDEXED_APPEND(int, &set, 5);
+ * struct list_int *node = LIST_FIND(int, &set, 5);
+ * LIST_DEL_KEY(int, &set, 5);
+ * LIST_INDEXED_DESTROY(int, &set);
+ * ```
+ */
+#ifdef KEY_TYPE
+#ifndef _LIST_IMPLEMENTATION
+/**
+ * Define key indexed list container struct
+ *
+ * @param T type parameter for list
+ */
+#define LIST_INDEXED_DEFN(T)                                                   \
+  struct list_indexed_##T {                                                    \
+    struct list_sentinal_##T list;                                             \
+    struct list_##T **slots; /* NULL marks an empty slot */                    \
+    size_t capacity;         /* Power of two, 0 until the first insert */      \
+  };
+EXPAND(LIST_INDEXED_DEFN, TYPE)
+#undef LIST_INDEXED_DEFN
+
+/**
+ * Key indexed list constructor
+ *
+ * @param T type of list to create
+ * @param d destructor for the list
+ */
+#define new_indexed_list(T, d)                                                 \
+  ({                                                                           \
+    struct list_indexed_##T __new_list_data = {0};                             \
+    _LIST_SET_DESTRUCTOR(&__new_list_data.list, d);                            \
+    __new_list_data;                                                           \
+  })
+
+/**
+ * Append an element to the tail of a key indexed list
+ *
+ * @return pointer to the new list_type, NULL if the key was already present
+ *
+ * @param T type of the list
+ * @param list pointer to list_indexed_type
+ * @param elem element of the same type as the list to append
+ */
+#define LIST_INDEXED_APPEND(T, list, elem) list_indexed_append_##T(list, elem)
+
+/**
+ * Prepend an element to the head of a key indexed list
+ *
+ * @return pointer to the new list_type, NULL if the key was already present
+ *
+ * @param T type of the list
+ * @param list pointer to list_indexed_type
+ * @param elem element of the same type as the list to prepend
+ */
+#define LIST_INDEXED_PREPEND(T, list, elem) list_indexed_prepend_##T(list, elem)
+
+/**
+ * Removes a node from a key indexed list without deleting it
+ *
+ * @param T type of the list
+ * @param list pointer to list_indexed_type
+ * @param node pointer to list_type to remove
+ */
+#define LIST_INDEXED_REMOVE(T, list, node) list_indexed_remove_##T(list, node)
+
+/**
+ * Deletes a node from a key indexed list
+ *
+ * @param T type of the list
+ * @param list pointer to list_indexed_type
+ * @param node pointer to list_type to delete
+ */
+#define LIST_INDEXED_DEL(T, list, node) list_indexed_del_##T(list, node)
+
+/**
+ * Looks up an element by key
+ *
+ * @return pointer to the list_type with the given key, NULL if there is none
+ *
+ * @param T type of the list
+ * @param list pointer to list_indexed_type
+ * @param key key to look for
+ */
+#define LIST_FIND(T, list, key) list_find_##T(list, key)
+
+/**
+ * Deletes the element with the given key
+ *
+ * @return 1 if an element was deleted, 0 if the key was not present
+ *
+ * @param T type of the list
+ * @param list pointer to list_indexed_type
+ * @param key key of the element to delete
+ */
+#define LIST_DEL_KEY(T, list, key) list_del_key_##T(list, key)
+
+/**
+ * Key indexed list destructor
+ *
+ * @param T type of the list
+ * @param list pointer to list_indexed_type to be destroyed
+ */
+#define LIST_INDEXED_DESTROY(T, list) list_indexed_destroy_##T(list)
+
+/**
+ * LRU cache
+ *
+ * lru_TYPE is generated along with the key indexed list. It keeps at most
+ * capacity elements, most recently used first. A hit moves the element to the
+ * head by relinking its node, and inserting into a full cache evicts the tail,
+ * calling the destructor on it. Nodes come from a pool owned by the cache, so
+ * once it is full, put never allocates.
+ *
+ * The cache refers to itself and is initialized in place with LRU_INIT, so it
+ * must not be copied.
+ *
+ * e.g.
+ *
+ * ```
+ * struct lru_kv cache;
+ * LRU_INIT(kv, &cache, 128, NULL);
+ * LRU_PUT(kv, &cache, ((kv){1, 10}));
+ * kv *hit = LRU_GET(kv, &cache, 1);
+ * LRU_DESTROY(kv, &cache);
+ * ```
+ *
+ * @param T type parameter for list
+ */
+#define LRU_DEFN(T)                                                            \
+  struct lru_##T {                                                             \
+    struct list_indexed_##T index; /* Most recently used at the head */        \
+    struct list_pool pool;                                                     \
+    size_t capacity;                                                           \
+    size_t hits;                                                               \
+    size_t misses;                                                             \
+  };
+EXPAND(LRU_DEFN, TYPE)
+#undef LRU_DEFN
+
+/**
+ * LRU cache constructor
+ *
+ * @param T type of the cache
+ * @param lru pointer to lru_type to initialize
+ * @param capacity maximum number of elements, at least 1
+ * @param d destructor called on evicted and replaced elements
+ */
+#define LRU_INIT(T, lru, capacity, d)                                          \
+  ({                                                                           \
+    _LIST_CHECK_DESTRUCTOR(&(lru)->index.list, d);                             \
+    lru_init_##T(lru, capacity, d);                                            \
+  })
+
+/**
+ * Looks up an element and marks it as most recently used
+ *
+ * @return pointer to the cached element, NULL on a miss
+ *
+ * @param T type of the cache
+ * @param lru pointer to lru_type
+ * @param key key to look for
+ */
+#define LRU_GET(T, lru, key) lru_get_##T(lru, key)
+
+/**
+ * Inserts or replaces an element as the most recently used one
+ *
+ * An element with the same key is replaced, after calling the destructor on
+ * it. Otherwise the least recently used element is evicted if the cache is
+ * full.
+ *
+ * @return pointer to the cached copy of elem
+ *
+ * @param T type of the cache
+ * @param lru pointer to lru_type
+ * @param elem element to insert
+ */
+#define LRU_PUT(T, lru, elem) lru_put_##T(lru, elem)
+
+/**
+ * LRU cache destructor
+ *
+ * @param T type of the cache
+ * @param lru pointer to lru_type to be destroyed
+ */
+#define LRU_DESTROY(T, lru) lru_destroy_##T(lru)
+#endif
+
+#ifdef KEY_EQ
+#define _LIST_KEY_EQ(a, b) KEY_EQ(a, b)
+#else
+#define _LIST_KEY_EQ(a, b) ((a) == (b))
+#endif
+
+/**
+ * Defines key indexed list functions
+ *
+ * Linear probing with backward shift deletion, so there are no tombstones
+ * and the table is grown to keep it at most half full.
+ *
+ * @param T type parameter for list
+ * @param K type of the keys
+ */
+#define LIST_INDEXED_FNS(T, K)                                                 \
+  _LIST_FN(size_t _list_index_slot_##T(struct list_indexed_##T *list, K key),  \
+           {                                                                   \
+             size_t mask = list->capacity - 1;                                 \
+             size_t slot = (size_t)(KEY_HASH(key)) & mask;                     \
+             while (list->slots[slot] &&                                       \
+                    !_LIST_KEY_EQ(KEY_OF(list->slots[slot]->entry), key))      \
+               slot = (slot + 1) & mask;                                       \
+             return slot;                                                      \
+           })                                                                  \
+  _LIST_FN(struct list_##T *list_find_##T(struct list_indexed_##T *list,       \
+                                          K key),                              \
+           {                                                                   \
+             if (!list->capacity)                                              \
+               return NULL;                                                    \
+             return list->slots[_list_index_slot_##T(list, key)];              \
+           })                                                                  \
+  _LIST_FN(int _list_index_reserve_##T(struct list_indexed_##T *list), {       \
+    if ((list->list.length + 1) * 2 <= list->capacity)                         \
+      return 1;                                                                \
+    size_t old_capacity = list->capacity;                                      \
+    struct list_##T **old_slots = list->slots;                                 \
+    size_t capacity = old_capacity ? old_capacity * 2 : 16;                    \
+    struct list_##T **slots = calloc(capacity, sizeof(*slots));                \
+    if (!slots)                                                                \
+      return 0;                                                                \
+    list->slots = slots;                                                       \
+    list->capacity = capacity;                                                 \
+    for (size_t i = 0; i < old_capacity; i++)                                  \
+      if (old_slots[i])                                                        \
+        slots[_list_index_slot_##T(list, KEY_OF(old_slots[i]->entry))] =       \
+            old_slots[i];                                                      \
+    free(old_slots);                                                           \
+    return 1;                                                                  \
+  })                                                                           \
+  _LIST_FN(struct list_##T *list_indexed_append_##T(                           \
+               struct list_indexed_##T *list, T elem),                         \
+           {                                                                   \
+             if (!_list_index_reserve_##T(list))                               \
+               return NULL;                                                    \
+             size_t slot = _list_index_slot_##T(list, KEY_OF(elem));           \
+             if (list->slots[slot])                                            \
+               return NULL;                                                    \
+             LIST_APPEND(&list->list, elem);                                   \
+             return list->slots[slot] = list->list.tail;                       \
+           })                                                                  \
+  _LIST_FN(struct list_##T *list_indexed_prepend_##T(                          \
+               struct list_indexed_##T *list, T elem),                         \
+           {                                                                   \
+             if (!_list_index_reserve_##T(list))                               \
+               return NULL;                                                    \
+             size_t slot = _list_index_slot_##T(list, KEY_OF(elem));           \
+             if (list->slots[slot])                                            \
+               return NULL;                                                    \
+             LIST_PREPEND(&list->list, elem);                                  \
+             return list->slots[slot] = list->list.head;                       \
+           })                                                                  \
+  _LIST_FN(void list_indexed_remove_##T(struct list_indexed_##T *list,         \
+                                        struct list_##T *node),                \
+           {                                                                   \
+             size_t mask = list->capacity - 1;                                 \
+             size_t hole = _list_index_slot_##T(list, KEY_OF(node->entry));    \
+             list->slots[hole] = NULL;                                         \
+             /* Pull back entries that probed past the hole */                 \
+             for (size_t slot = (hole + 1) & mask; list->slots[slot];          \
+                  slot = (slot + 1) & mask) {                                  \
+               size_t home =                                                   \
+                   (size_t)(KEY_HASH(KEY_OF(list->slots[slot]->entry))) &      \
+                   mask;                                                       \
+               if (((slot - home) & mask) >= ((slot - hole) & mask)) {         \
+                 list->slots[hole] = list->slots[slot];                        \
+                 list->slots[slot] = NULL;                                     \
+                 hole = slot;                                                  \
+               }                                                               \
+             }                                                                 \
+             LIST_REMOVE(&list->list, node);                                   \
+           })                                                                  \
+  _LIST_FN(void list_indexed_del_##T(struct list_indexed_##T *list,            \
+                                     struct list_##T *node),                   \
+           {                                                                   \
+             list_indexed_remove_##T(list, node);                              \
+             _LIST_DESTRUCT(&list->list, node->entry);                         \
+             LIST_NODE_FREE(&list->list, node);                                \
+           })                                                                  \
+  _LIST_FN(int list_del_key_##T(struct list_indexed_##T *list, K key), {       \
+    struct list_##T *node = list_find_##T(list, key);                          \
+    if (node)                                                                  \
+      list_indexed_del_##T(list, node);                                        \
+    return node != NULL;                                                       \
+  })                                                                           \
+  _LIST_FN(void list_indexed_destroy_##T(struct list_indexed_##T *list), {     \
+    LIST_DESTROY(&list->list);                                                 \
+    free(list->slots);                                                         \
+    list->slots = NULL;                                                        \
+    list->capacity = 0;                                                        \
+  })
+EXPAND1(LIST_INDEXED_FNS, TYPE, KEY_TYPE)
+#undef LIST_INDEXED_FNS
+
+/**
+ * Defines LRU cache functions
+ *
+ * @param T type parameter for list
+ * @param K type of the keys
+ */
+#define LRU_FNS(T, K)                                                          \
+  _LIST_FN(void lru_init_##T(struct lru_##T *lru, size_t capacity,             \
+                             list_destructor_##T d),                           \
+           {                                                                   \
+             lru->index = new_indexed_list(T, NULL);                           \
+             _LIST_STORE_DESTRUCTOR(&lru->index.list, d);                      \
+             lru->capacity = capacity ? capacity : 1;                          \
+             lru->hits = lru->misses = 0;                                      \
+             list_pool_init(&lru->pool, sizeof(struct list_##T),               \
+                            lru->capacity < 256 ? lru->capacity : 256);        \
+             lru->index.list.allocator = &lru->pool.allocator;                 \
+           })                                                                  \
+  _LIST_FN(void _lru_touch_##T(struct lru_##T *lru, struct list_##T *node), {  \
+    if (node == lru->index.list.head)                                          \
+      return;                                                                  \
+    LIST_REMOVE(&lru->index.list, node);                                       \
+    _LIST_LINK(&lru->index.list, node, head, tail, prev, next);                \
+  })                                                                           \
+  _LIST_FN(T *lru_get_##T(struct lru_##T *lru, K key), {                       \
+    struct list_##T *node = list_find_##T(&lru->index, key);                   \
+    if (!node) {                                                               \
+      lru->misses++;                                                           \
+      return NULL;                                                             \
+    }                                                                          \
+    lru->hits++;                                                               \
+    _lru_touch_##T(lru, node);                                                 \
+    return &node->entry;                                                       \
+  })                                                                           \
+  _LIST_FN(T *lru_put_##T(struct lru_##T *lru, T elem), {                      \
+    struct list_##T *node = list_find_##T(&lru->index, KEY_OF(elem));          \
+    if (node) {                                                                \
+      _LIST_DESTRUCT(&lru->index.list, node->entry);                           \
+      node->entry = elem;                                                      \
+      _lru_touch_##T(lru, node);                                               \
+      return &node->entry;                                                     \
+    }                                                                          \
+    if (lru->index.list.length >= lru->capacity)                               \
+      list_indexed_del_##T(&lru->index, lru->index.list.tail);                 \
+    node = list_indexed_prepend_##T(&lru->index, elem);                        \
+    return node ? &node->entry : NULL;                                         \
+  })                                                                           \
+  _LIST_FN(void lru_destroy_##T(struct lru_##T *lru), {                        \
+    /* Every node belongs to the pool, which is released as a whole */         \
+    LIST_ABANDON(&lru->index.list);                                            \
+    free(lru->index.slots);                                                    \
+    lru->index.slots = NULL;                                                   \
+    lru->index.capacity = 0;                                                   \
+    list_pool_destroy(&lru->pool);                                             \
+  })
+EXPAND1(LRU_FNS, TYPE, KEY_TYPE)
+#undef LRU_FNS
+#undef _LIST_KEY_EQ
 #endif
 
 // Cleaning up expansion macros
 #undef EXPAND
 #undef EXPAND1
+#undef _LIST_FN
 
 // Remove internal macros
 #undef TYPEHACK_H
@@ -0,0 +1,187 @@
+/**
+ * Microbenchmarks for list.h
+ *
+ * Prints one CSV row per measurement:
+ *   op,type,elem_size,length,reps,total_ns,ns_per_elem
+ *
+ * Usage: list_bench [max_length]
+ *   Lengths go from 10 up to max_length (default 1000000) in powers of ten.
+ *   Short lists are rebuilt enough times to touch about BENCH_ELEMS elements.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ELEMS 1000000
+
+typedef struct {
+  char bytes[64];
+} rec64;
+
+typedef struct {
+  char bytes[256];
+} rec256;
+
+// Gives int the same .bytes accessor as the record types
+typedef union {
+  int value;
+  char bytes[sizeof(int)];
+} bench_int;
+
+#define TYPE bench_int
+#include "list.h"
+#undef TYPE
+
+#define TYPE rec64
+#include "list.h"
+#undef TYPE
+
+#define TYPE rec256
+#include "list.h"
+#undef TYPE
+
+// Keeps the compiler from discarding the work being measured
+volatile unsigned long bench_sink;
+
+static unsigned long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void report(const char *op, const char *type, size_t size,
+                   size_t length, size_t reps, unsigned long long ns) {
+  printf("%s,%s,%zu,%zu,%zu,%llu,%.3f\n", op, type, size, length, reps, ns,
+         (double)ns / ((double)length * reps));
+}
+
+/**
+ * Times code once per repetition, excluding setup and teardown
+ */
+#define BENCH_TIMED(total, reps, setup, code, teardown)                        \
+  do {                                                                         \
+    for (size_t __rep = 0; __rep < (reps); __rep++) {                          \
+      setup;                                                                   \
+      unsigned long long __start = now_ns();                                   \
+      code;                                                                    \
+      (total) += now_ns() - __start;                                           \
+      teardown;                                                                \
+    }                                                                          \
+  } while (0)
+
+/**
+ * Defines bench_T, which runs every measurement for lists of T
+ *
+ * @param T type parameter for list
+ * @param name type name to report
+ */
+#define BENCH_TYPE(T, name)                                                    \
+  static void bench_##T(size_t n, size_t reps) {                               \
+    T value;                                                                   \
+    memset(&value, 1, sizeof(value));                                          \
+    T *array = malloc(sizeof(T) * n);                                          \
+    for (size_t i = 0; i < n; i++)                                             \
+      array[i] = value;                                                        \
+    struct list_sentinal_##T list = new_list(T, NULL);                         \
+    unsigned long long ns;                                                     \
+                                                                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, {                                                \
+      for (size_t i = 0; i < n; i++)                                           \
+        LIST_APPEND(&list, value);                                             \
+    }, LIST_DESTROY(&list));                                                   \
+    report("append", name, sizeof(T), n, reps, ns);                            \
+                                                                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, {                                                \
+      for (size_t i = 0; i < n; i++)                                           \
+        LIST_PREPEND(&list, value);                                            \
+    }, LIST_DESTROY(&list));                                                   \
+    report("prepend", name, sizeof(T), n, reps, ns);                           \
+                                                                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {                                                    \
+      for (size_t i = 0; i < n; i++)                                           \
+        LIST_APPEND(&list, value);                                             \
+    }, {                                                                       \
+      while (list.length)                                                      \
+        bench_sink += LIST_POPF(&list).bytes[0];                               \
+    }, {});                                                                    \
+    report("popf", name, sizeof(T), n, reps, ns);                              \
+                                                                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, LIST_APPEND_ARRAY(&list, array, n),              \
+                LIST_DESTROY(&list));                                          \
+    report("append_array", name, sizeof(T), n, reps, ns);                      \
+                                                                               \
+    for (size_t i = 0; i < n; i++)                                             \
+      LIST_APPEND(&list, value);                                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, {                                                \
+      LIST_FOR_EACH(&list, elem, { bench_sink += elem->entry.bytes[0]; });     \
+    }, {});                                                                    \
+    report("for_each", name, sizeof(T), n, reps, ns);                          \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, {                                                \
+      LIST_FOR_EACH_PREFETCH(&list, elem, 8,                                   \
+                             { bench_sink += elem->entry.bytes[0]; });         \
+    }, {});                                                                    \
+    report("for_each_prefetch", name, sizeof(T), n, reps, ns);                 \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, LIST_TO_ARRAY(&list, array), {});                \
+    report("to_array", name, sizeof(T), n, reps, ns);                          \
+    LIST_DESTROY(&list);                                                       \
+                                                                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {                                                    \
+      for (size_t i = 0; i < n; i++)                                           \
+        LIST_APPEND(&list, value);                                             \
+    }, LIST_DESTROY(&list), {});                                               \
+    report("destroy", name, sizeof(T), n, reps, ns);                           \
+                                                                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {                                                    \
+      for (size_t i = 0; i < n; i++)                                           \
+        LIST_APPEND(&list, array[i]);                                          \
+    }, {                                                                       \
+      size_t i = 0;                                                            \
+      bench_sink += LIST_FILTER(&list, elem, i++ % 2);                         \
+    }, LIST_DESTROY(&list));                                                   \
+    report("filter_half", name, sizeof(T), n, reps, ns);                       \
+                                                                               \
+    struct deque_##T deque = new_deque(T, NULL);                               \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, {                                                \
+      for (size_t i = 0; i < n; i++)                                           \
+        DEQUE_APPEND(&deque, value);                                           \
+    }, DEQUE_DESTROY(&deque));                                                 \
+    report("deque_append", name, sizeof(T), n, reps, ns);                      \
+                                                                               \
+    for (size_t i = 0; i < n; i++)                                             \
+      DEQUE_APPEND(&deque, value);                                             \
+    ns = 0;                                                                    \
+    BENCH_TIMED(ns, reps, {}, {                                                \
+      DEQUE_FOR_EACH(&deque, elem, { bench_sink += elem->entry.bytes[0]; });   \
+    }, {});                                                                    \
+    report("deque_for_each", name, sizeof(T), n, reps, ns);                    \
+    DEQUE_DESTROY(&deque);                                                     \
+                                                                               \
+    free(array);                                                               \
+  }
+
+BENCH_TYPE(bench_int, "int")
+BENCH_TYPE(rec64, "rec64")
+BENCH_TYPE(rec256, "rec256")
+
+int main(int argc, char **argv) {
+  size_t max_length = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+  puts("op,type,elem_size,length,reps,total_ns,ns_per_elem");
+  for (size_t n = 10; n <= max_length; n *= 10) {
+    size_t reps = n < BENCH_ELEMS ? BENCH_ELEMS / n : 1;
+    bench_bench_int(n, reps);
+    bench_rec64(n, reps);
+    bench_rec256(n, reps);
+  }
+  return 0;
+}
@@ -0,0 +1,274 @@
+/**
+ * Soak benchmark for list.h
+ *
+ * Runs a long mixed workload of appends, prepends, deletes and pops against
+ * one list and samples it at regular intervals, to catch slowdowns that only
+ * show up after a lot of allocator churn. Prints one CSV row per sample:
+ *   variant,sample,ops,length,rss_kb,ops_per_sec,p50_ns,p99_ns,iter_ns_per_elem
+ *
+ * ops_per_sec, p50_ns and p99_ns cover the operations since the previous
+ * sample, iter_ns_per_elem is one full traversal of the list at the sample.
+ *
+ * Usage: list_soak [variant] [ops] [length]
+ *   variant is one of malloc, cache, pool, chunk, deque or all (default)
+ *   ops is the number of operations per variant (default 10000000)
+ *   length is the length the list is kept around (default 100000)
+ *
+ * Each operation is picked at random with equal odds, biased to keep the
+ * length between half and one and a half times length. Deletes remove a
+ * random element from linked lists, and the tail from chunked lists and
+ * deques, which can't remove from the middle.
+ *
+ * RSS is the whole process', so run one variant at a time to compare memory
+ * use, since memory freed by one variant may not be returned to the system.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define SOAK_SAMPLES 20
+
+typedef struct {
+  size_t slot; /* Index of the element in soak_handles, linked lists only */
+  long payload;
+} soak_item;
+
+#define TYPE soak_item
+#include "list.h"
+#undef TYPE
+
+// Keeps the compiler from discarding the traversals
+volatile long soak_sink;
+
+// Duration of the last SOAK_TIMED operation
+static unsigned long long soak_op_ns;
+
+// Nodes of the linked list variants, so deletes can pick a random element
+static struct list_soak_item **soak_handles;
+static size_t soak_handle_count;
+
+static unsigned long long soak_rng = 88172645463325252ull;
+
+static unsigned long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned long long soak_random() {
+  soak_rng ^= soak_rng << 13;
+  soak_rng ^= soak_rng >> 7;
+  soak_rng ^= soak_rng << 17;
+  return soak_rng;
+}
+
+// Current resident set size, or the peak where the current one is unknown
+static long rss_kb() {
+#ifdef __linux__
+  long size, pages = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    if (fscanf(statm, "%ld %ld", &size, &pages) != 2)
+      pages = 0;
+    fclose(statm);
+  }
+  return pages * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static int cmp_ns(const void *a, const void *b) {
+  unsigned a_ns = *(const unsigned *)a, b_ns = *(const unsigned *)b;
+  return (a_ns > b_ns) - (a_ns < b_ns);
+}
+
+static void soak_track(struct list_soak_item *node) {
+  node->entry.slot = soak_handle_count;
+  soak_handles[soak_handle_count++] = node;
+}
+
+static void soak_forget(struct list_soak_item *node) {
+  struct list_soak_item *last = soak_handles[--soak_handle_count];
+  soak_handles[node->entry.slot] = last;
+  last->entry.slot = node->entry.slot;
+}
+
+/**
+ * Times code, storing the duration in soak_op_ns
+ */
+#define SOAK_TIMED(code)                                                       \
+  do {                                                                         \
+    unsigned long long __start = now_ns();                                     \
+    code;                                                                      \
+    soak_op_ns = now_ns() - __start;                                           \
+  } while (0)
+
+/**
+ * Defines soak_name, which runs the workload against one variant
+ *
+ * Every operation is a block using list, item (the soak_item to add) and
+ * SOAK_TIMED around the list operation alone, leaving out any bookkeeping.
+ *
+ * @param name variant name to report
+ * @param decl declares and initializes list
+ * @param append, prepend, del, popf code for each operation
+ * @param iterate code adding every payload of list to soak_sink
+ * @param teardown code destroying list
+ */
+#define SOAK_VARIANT(name, decl, append, prepend, del, popf, iterate,          \
+                     teardown)                                                 \
+  static void soak_##name(size_t ops, size_t length) {                         \
+    decl;                                                                      \
+    size_t sample_ops = ops / SOAK_SAMPLES ? ops / SOAK_SAMPLES : 1;           \
+    unsigned *latency = malloc(sizeof(*latency) * sample_ops);                 \
+    soak_handles = malloc(sizeof(*soak_handles) * (length * 2 + 2));           \
+    soak_handle_count = 0;                                                     \
+    soak_item item = {0, 0};                                                   \
+    for (size_t i = 0; i < length; i++, item.payload++)                        \
+      append;                                                                  \
+    size_t len = length;                                                       \
+    for (size_t done = 0, sample = 1; done < ops; sample++) {                  \
+      size_t n = ops - done < sample_ops ? ops - done : sample_ops;            \
+      unsigned long long start = now_ns();                                     \
+      for (size_t i = 0; i < n; i++, item.payload++) {                         \
+        unsigned op = soak_random() % 4;                                       \
+        if (op >= 2 && (len <= length / 2 || !len))                            \
+          op -= 2;                                                             \
+        else if (op < 2 && len && len >= length + length / 2)                  \
+          op += 2;                                                             \
+        switch (op) {                                                          \
+        case 0:                                                                \
+          append;                                                              \
+          len++;                                                               \
+          break;                                                               \
+        case 1:                                                                \
+          prepend;                                                             \
+          len++;                                                               \
+          break;                                                               \
+        case 2:                                                                \
+          del;                                                                 \
+          len--;                                                               \
+          break;                                                               \
+        default:                                                               \
+          popf;                                                                \
+          len--;                                                               \
+        }                                                                      \
+        latency[i] = soak_op_ns;                                               \
+      }                                                                        \
+      double secs = (now_ns() - start) / 1e9;                                  \
+      done += n;                                                               \
+      qsort(latency, n, sizeof(*latency), cmp_ns);                             \
+      unsigned long long iter_start = now_ns();                                \
+      iterate;                                                                 \
+      unsigned long long iter_ns = now_ns() - iter_start;                      \
+      printf("%s,%zu,%zu,%zu,%ld,%.0f,%u,%u,%.3f\n", #name, sample, done, len, \
+             rss_kb(), n / secs, latency[n / 2], latency[n * 99 / 100],        \
+             len ? (double)iter_ns / len : 0.0);                               \
+      fflush(stdout);                                                          \
+    }                                                                          \
+    teardown;                                                                  \
+    free(soak_handles);                                                        \
+    free(latency);                                                             \
+  }
+
+/**
+ * Defines soak_name for a list_sentinal_soak_item built by decl
+ */
+#define SOAK_LINKED(name, decl, teardown)                                      \
+  SOAK_VARIANT(                                                                \
+      name, decl,                                                              \
+      {                                                                        \
+        SOAK_TIMED(LIST_APPEND(&list, item));                                  \
+        soak_track(list.tail);                                                 \
+      },                                                                       \
+      {                                                                        \
+        SOAK_TIMED(LIST_PREPEND(&list, item));                                 \
+        soak_track(list.head);                                                 \
+      },                                                                       \
+      {                                                                        \
+        struct list_soak_item *node =                                          \
+            soak_handles[soak_random() % soak_handle_count];                   \
+        soak_forget(node);                                                     \
+        SOAK_TIMED(LIST_DEL(&list, node));                                     \
+      },                                                                       \
+      {                                                                        \
+        soak_forget(list.head);                                                \
+        SOAK_TIMED(soak_sink += LIST_POPF(&list).payload);                     \
+      },                                                                       \
+      LIST_FOR_EACH(&list, elem, { soak_sink += elem->entry.payload; }),       \
+      teardown)
+
+SOAK_LINKED(malloc, struct list_sentinal_soak_item list =
+                        new_list(soak_item, NULL),
+            LIST_DESTROY(&list))
+
+SOAK_LINKED(cache,
+            struct list_sentinal_soak_item list = new_list(soak_item, NULL);
+            LIST_SET_CACHE_CAPACITY(&list, 1024), LIST_DESTROY(&list))
+
+SOAK_LINKED(pool, struct list_pool pool;
+            list_pool_init(&pool, sizeof(struct list_soak_item), 1024);
+            struct list_sentinal_soak_item list =
+                new_list_alloc(soak_item, NULL, &pool.allocator),
+            LIST_DESTROY(&list); list_pool_destroy(&pool))
+
+SOAK_VARIANT(chunk,
+             struct list_chunk_sentinal_soak_item list =
+                 new_chunk_list(soak_item, NULL),
+             SOAK_TIMED(LIST_CHUNK_APPEND(&list, item)),
+             SOAK_TIMED(LIST_CHUNK_PREPEND(&list, item)),
+             SOAK_TIMED(soak_sink += LIST_CHUNK_POPB(&list).payload),
+             SOAK_TIMED(soak_sink += LIST_CHUNK_POPF(&list).payload),
+             LIST_CHUNK_FOR_EACH(&list, elem, { soak_sink += elem->payload; }),
+             LIST_CHUNK_DESTROY(&list))
+
+SOAK_VARIANT(deque,
+             struct deque_soak_item list = new_deque(soak_item, NULL),
+             SOAK_TIMED(DEQUE_APPEND(&list, item)),
+             SOAK_TIMED(DEQUE_PREPEND(&list, item)),
+             SOAK_TIMED(soak_sink += DEQUE_POPB(&list).payload),
+             SOAK_TIMED(soak_sink += DEQUE_POPF(&list).payload),
+             DEQUE_FOR_EACH(&list, elem, { soak_sink += elem->entry.payload; }),
+             DEQUE_DESTROY(&list))
+
+static const struct {
+  const char *name;
+  void (*run)(size_t ops, size_t length);
+} soak_variants[] = {
+    {"malloc", soak_malloc}, {"cache", soak_cache}, {"pool", soak_pool},
+    {"chunk", soak_chunk},   {"deque", soak_deque},
+};
+
+int main(int argc, char **argv) {
+  const char *variant = argc > 1 ? argv[1] : "all";
+  size_t ops = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+  size_t length = argc > 3 ? strtoull(argv[3], NULL, 10) : 100000;
+  int found = 0;
+  puts("variant,sample,ops,length,rss_kb,ops_per_sec,p50_ns,p99_ns,"
+       "iter_ns_per_elem");
+  for (size_t i = 0; i < sizeof(soak_variants) / sizeof(*soak_variants);
+       i++) {
+    if (strcmp(variant, "all") && strcmp(variant, soak_variants[i].name))
+      continue;
+    soak_variants[i].run(ops, length);
+    found = 1;
+  }
+  if (!found) {
+    fprintf(stderr, "unknown variant %s\n", variant);
+    return 1;
+  }
+  return 0;
+}
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +21,68 @@
 #undef TYPE_PTR
 #undef TYPE
 
+typedef struct {
+  int id;
+  char payload[252];
+} record;
+
+#define TYPE record
+#include "list.h"
+#undef TYPE
+
+typedef struct {
+  int key;
+  int value;
+} kv;
+
+#define TYPE kv
+#define KEY_TYPE int
+#define KEY_OF(entry) ((entry).key)
+#define KEY_HASH(key) ((size_t)(key) * 0x9E3779B97F4A7C15ull)
+#include "list.h"
+#undef KEY_HASH
+#undef KEY_OF
+#undef KEY_TYPE
+#undef TYPE
+
+typedef int tiny;
+
+#define TYPE tiny
+#define LIST_INLINE_CAPACITY 4
+#include "list.h"
+#undef LIST_INLINE_CAPACITY
+#undef TYPE
+
+typedef long traced;
+
+#define TYPE traced
+#define LIST_STATS
+#include "list.h"
+#undef LIST_STATS
+#undef TYPE
+
+typedef unsigned plain;
+
+#define TYPE plain
+#define TYPE_TRIVIAL
+#include "list.h"
+#undef TYPE_TRIVIAL
+#undef TYPE
+
+typedef kv flat_kv;
+
+#define TYPE flat_kv
+#define TYPE_TRIVIAL
+#define KEY_TYPE int
+#define KEY_OF(entry) ((entry).key)
+#define KEY_HASH(key) ((size_t)(key))
+#include "list.h"
+#undef KEY_HASH
+#undef KEY_OF
+#undef KEY_TYPE
+#undef TYPE_TRIVIAL
+#undef TYPE
+
 #ifdef ERROR_TEST
 //won't compile
 #include "list.h" 
@@ -100,10 +164,1480 @@ int str_test() {
   LIST_DESTROY(&my_c_list);
 }
 
+int pool_test() {
+  struct list_pool pool;
+  list_pool_init(&pool, sizeof(struct list_int), 4);
+  struct list_sentinal_int my_list = new_list_alloc(int, NULL, &pool.allocator);
+
+  for (int i = 0; i < 4; i++)
+    LIST_APPEND(&my_list, i);
+  // All four nodes come from the first slab
+  assert(pool.slabs && !*(void **)pool.slabs);
+  assert(!pool.free_nodes);
+
+  // Steady state append/pop reuses the node that was just released
+  for (int i = 4; i < 100; i++) {
+    struct list_int *head = my_list.head;
+    assert(LIST_POPF(&my_list) == i - 4);
+    assert(pool.free_nodes == head);
+    LIST_APPEND(&my_list, i);
+    assert(my_list.tail == head);
+  }
+  assert(!*(void **)pool.slabs);
+  assert(my_list.length == 4);
+
+  // Growing past the slab adds another one
+  LIST_PREPEND(&my_list, 95);
+  assert(*(void **)pool.slabs);
+  assert(LIST_POPB(&my_list) == 99);
+
+  LIST_DESTROY(&my_list);
+  list_pool_destroy(&pool);
+  assert(!pool.slabs);
+  return 0;
+}
+
+int bulk_test() {
+  int array[1000];
+  for (int i = 0; i < 1000; i++)
+    array[i] = i;
+
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  LIST_APPEND(&my_list, -1);
+  LIST_APPEND_ARRAY(&my_list, array, 1000);
+  LIST_PREPEND_ARRAY(&my_list, array, 3);
+  assert(my_list.length == 1004);
+
+  // Nodes of a bulk add are laid out in list order
+  struct list_int *first = my_list.head->next->next->next->next;
+  assert(first->entry == 0);
+  int counter = 0;
+  LIST_FOR_EACH(&my_list, elem, {
+    if (counter < 3)
+      assert(elem->entry == 2 - counter);
+    else if (counter == 3)
+      assert(elem->entry == -1);
+    else {
+      assert(elem->entry == counter - 4);
+      assert(elem == first + (counter - 4));
+    }
+    counter++;
+  });
+  assert(counter == 1004);
+  assert(my_list.tail == first + 999);
+
+  // Nodes inside a slab can be deleted individually
+  LIST_FOR_EACH_SAFE(&my_list, elem, temp, {
+    if (elem->entry % 2)
+      LIST_DEL(&my_list, elem);
+  });
+  assert(my_list.length == 502);
+  assert(my_list.head->entry == 2);
+  assert(my_list.tail->entry == 998);
+
+  // Draining the prepended slab releases it
+  assert(LIST_POPF(&my_list) == 2);
+  assert(LIST_POPF(&my_list) == 0);
+  assert(my_list.head->slab && my_list.head->slab == my_list.tail->slab);
+  assert(my_list.head->slab->live == 500);
+
+  LIST_APPEND_ARRAY(&my_list, array, 0);
+  assert(my_list.length == 500);
+  LIST_DESTROY(&my_list);
+  assert(!my_list.bulk);
+  return 0;
+}
+
+int chunk_test() {
+  struct list_chunk_sentinal_int my_list = new_chunk_list(int, NULL);
+  assert(LIST_CHUNK_CAPACITY(&my_list) == 16);
+
+  for (int i = 0; i < 40; i++)
+    assert(LIST_CHUNK_APPEND(&my_list, i) == (size_t)i + 1);
+  for (int i = 1; i <= 20; i++)
+    LIST_CHUNK_PREPEND(&my_list, -i);
+  assert(my_list.length == 60);
+  // 40 appended entries fill 3 chunks, 20 prepended ones 2 more
+  int chunks = 0;
+  for (struct list_chunk_int *c = my_list.head; c; c = c->next)
+    chunks++;
+  assert(chunks == 5);
+
+  int counter = -20;
+  LIST_CHUNK_FOR_EACH(&my_list, elem, {
+    assert(*elem == counter);
+    counter++;
+  });
+  assert(counter == 40);
+  LIST_CHUNK_FOR_EACH_REV(&my_list, elem, {
+    counter--;
+    assert(*elem == counter);
+  });
+  assert(counter == -20);
+
+  for (int i = -20; i < 0; i++)
+    assert(LIST_CHUNK_POPF(&my_list) == i);
+  for (int i = 39; i >= 30; i--)
+    assert(LIST_CHUNK_POPB(&my_list) == i);
+  assert(my_list.length == 30);
+  assert(my_list.head->entries[my_list.head->start] == 0);
+  assert(my_list.tail->entries[my_list.tail->start + my_list.tail->count - 1] ==
+         29);
+
+  // Draining a list frees every chunk
+  while (my_list.length)
+    LIST_CHUNK_POPF(&my_list);
+  assert(!my_list.head && !my_list.tail);
+
+  LIST_CHUNK_PREPEND(&my_list, 1);
+  LIST_CHUNK_APPEND(&my_list, 2);
+  assert(LIST_CHUNK_POPB(&my_list) == 2);
+  assert(LIST_CHUNK_POPB(&my_list) == 1);
+  assert(!my_list.head && !my_list.tail);
+
+  void str_destroy(char *str) { free(str); }
+  struct list_chunk_sentinal__str str_list = new_chunk_list(_str, str_destroy);
+  for (int i = 0; i < 20; i++)
+    LIST_CHUNK_APPEND(&str_list, strdup("x"));
+  LIST_CHUNK_DESTROY(&str_list);
+  assert(!str_list.length && !str_list.head);
+  LIST_CHUNK_DESTROY(&my_list);
+  return 0;
+}
+
+struct conn {
+  int id;
+  struct list_link all;
+  struct list_link idle;
+};
+
+int intrusive_test() {
+  struct conn conns[5];
+  struct list_intrusive all = new_intrusive_list();
+  struct list_intrusive idle = new_intrusive_list();
+  for (int i = 0; i < 5; i++) {
+    conns[i].id = i;
+    assert(LIST_INTRUSIVE_APPEND(&all, &conns[i], all) == (size_t)i + 1);
+    if (i % 2)
+      LIST_INTRUSIVE_PREPEND(&idle, &conns[i], idle);
+  }
+  assert(LIST_CONTAINER_OF(all.head, struct conn, all) == &conns[0]);
+  assert(LIST_CONTAINER_OF(idle.head, struct conn, idle) == &conns[3]);
+
+  // Removing from one list leaves the other untouched
+  LIST_INTRUSIVE_REMOVE(&all, &conns[3], all);
+  assert(all.length == 4);
+  assert(idle.length == 2);
+
+  int expected[] = {0, 1, 2, 4};
+  int counter = 0;
+  LIST_INTRUSIVE_FOR_EACH(&all, c, struct conn, all, {
+    assert(c->id == expected[counter]);
+    counter++;
+  });
+  assert(counter == 4);
+
+  LIST_INTRUSIVE_FOR_EACH_SAFE(&idle, c, struct conn, idle,
+                               { LIST_INTRUSIVE_REMOVE(&idle, c, idle); });
+  assert(!idle.length && !idle.head && !idle.tail);
+  return 0;
+}
+
+int emplace_test() {
+  struct list_sentinal_record my_list = new_list(record, NULL);
+  for (int i = 0; i < 3; i++) {
+    record *r = LIST_EMPLACE_APPEND(&my_list);
+    r->id = i;
+    memset(r->payload, 'a' + i, sizeof(r->payload));
+  }
+  record *r = LIST_EMPLACE_PREPEND(&my_list);
+  r->id = -1;
+  assert(r == &my_list.head->entry);
+  assert(my_list.length == 4);
+
+  int counter = -1;
+  LIST_FOR_EACH(&my_list, elem, {
+    assert(elem->entry.id == counter);
+    if (counter >= 0)
+      assert(elem->entry.payload[251] == 'a' + counter);
+    counter++;
+  });
+  LIST_DESTROY(&my_list);
+  return 0;
+}
+
+int splice_test() {
+  int array[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  struct list_sentinal_int a = new_list(int, NULL);
+  struct list_sentinal_int b = new_list(int, NULL);
+  struct list_sentinal_int c = new_list(int, NULL);
+  LIST_APPEND_ARRAY(&a, array, 3);
+  LIST_APPEND_ARRAY(&b, array + 3, 3);
+  for (int i = 6; i < 10; i++)
+    LIST_APPEND(&c, i);
+
+  assert(LIST_SPLICE(&a, &b) == 6);
+  assert(!b.head && !b.tail && !b.length && a.bulk);
+  // Splicing an empty list is a no-op
+  assert(LIST_SPLICE(&a, &b) == 6);
+  assert(LIST_SPLICE(&b, &a) == 6);
+  assert(!a.length);
+
+  // Insert c in front of the element 3
+  struct list_int *pos = b.head->next->next->next;
+  assert(pos->entry == 3);
+  LIST_SPLICE_AT(&b, pos, &c);
+  int expected[] = {0, 1, 2, 6, 7, 8, 9, 3, 4, 5};
+  int counter = 0;
+  LIST_FOR_EACH(&b, elem, { assert(elem->entry == expected[counter++]); });
+  counter = 10;
+  LIST_FOR_EACH_REV(&b, elem, { assert(elem->entry == expected[--counter]); });
+  assert(b.length == 10);
+  LIST_SPLICE_AT(&b, b.head, &c);
+  assert(b.head->entry == 0);
+
+  // Cut near the tail and near the head
+  assert(LIST_SPLIT(&b, b.tail->prev, &a) == 2);
+  assert(b.length == 8 && b.tail->entry == 3 && !b.tail->next);
+  assert(a.length == 2 && a.head->entry == 4 && !a.head->prev);
+  assert(LIST_SPLIT(&b, b.head->next, &a) == 7);
+  assert(b.length == 1 && b.head == b.tail && b.head->entry == 0);
+  assert(a.length == 9 && a.head->entry == 4 && a.tail->entry == 3);
+  assert(LIST_SPLIT(&b, b.head, &a) == 1);
+  assert(!b.head && !b.tail && !b.length);
+  assert(a.tail->entry == 0 && a.length == 10);
+
+  // Both halves of a split bulk slab can be destroyed independently
+  LIST_SPLIT(&a, a.head->next->next, &c);
+  LIST_DESTROY(&a);
+  LIST_DESTROY(&c);
+  LIST_DESTROY(&b);
+  return 0;
+}
+
+#define MPSC_PRODUCERS 4
+#define MPSC_ITEMS 10000
+
+struct list_mpsc_int mpsc_queue;
+
+void *mpsc_producer(void *arg) {
+  int id = *(int *)arg;
+  for (int i = 0; i < MPSC_ITEMS; i++)
+    LIST_MPSC_APPEND(&mpsc_queue, id * MPSC_ITEMS + i);
+  return NULL;
+}
+
+int mpsc_test() {
+  mpsc_queue = new_mpsc_list(int, NULL);
+  pthread_t threads[MPSC_PRODUCERS];
+  int ids[MPSC_PRODUCERS];
+  int next[MPSC_PRODUCERS] = {0};
+  for (int i = 0; i < MPSC_PRODUCERS; i++) {
+    ids[i] = i;
+    pthread_create(&threads[i], NULL, mpsc_producer, &ids[i]);
+  }
+
+  // Each producer's elements arrive in the order they were appended
+  int received = 0;
+  while (received < MPSC_PRODUCERS * MPSC_ITEMS / 2) {
+    int elem;
+    if (!LIST_MPSC_POPF(&mpsc_queue, &elem))
+      continue;
+    int id = elem / MPSC_ITEMS;
+    assert(elem % MPSC_ITEMS == next[id]);
+    next[id]++;
+    received++;
+  }
+  for (int i = 0; i < MPSC_PRODUCERS; i++)
+    pthread_join(threads[i], NULL);
+
+  assert(LIST_MPSC_LENGTH(&mpsc_queue) == MPSC_PRODUCERS * MPSC_ITEMS / 2);
+  struct list_sentinal_int batch = LIST_MPSC_TAKE(&mpsc_queue);
+  assert(batch.length == MPSC_PRODUCERS * MPSC_ITEMS / 2);
+  assert(!LIST_MPSC_LENGTH(&mpsc_queue));
+  LIST_FOR_EACH(&batch, elem, {
+    int id = elem->entry / MPSC_ITEMS;
+    assert(elem->entry % MPSC_ITEMS == next[id]);
+    assert(!elem->next || elem->next->prev == elem);
+    next[id]++;
+  });
+  for (int i = 0; i < MPSC_PRODUCERS; i++)
+    assert(next[i] == MPSC_ITEMS);
+  LIST_DESTROY(&batch);
+
+  int elem;
+  assert(!LIST_MPSC_POPF(&mpsc_queue, &elem));
+  LIST_MPSC_APPEND(&mpsc_queue, 1);
+  LIST_MPSC_APPEND(&mpsc_queue, 2);
+  assert(LIST_MPSC_POPF(&mpsc_queue, &elem) && elem == 1);
+  LIST_MPSC_DESTROY(&mpsc_queue);
+  return 0;
+}
+
+#define INT_CMP(a, b) ((a) - (b))
+#define RECORD_CMP(a, b) ((a).id - (b).id)
+
+int sort_test() {
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  LIST_SORT(&my_list, INT_CMP);
+  assert(!my_list.head && !my_list.tail);
+
+  // Pseudo random permutation of 0..999
+  for (int i = 0; i < 1000; i++)
+    LIST_APPEND(&my_list, (i * 7919) % 1000);
+  struct list_int *node = my_list.head;
+  LIST_SORT(&my_list, INT_CMP);
+  assert(my_list.length == 1000);
+  int counter = 0;
+  LIST_FOR_EACH(&my_list, elem, { assert(elem->entry == counter++); });
+  LIST_FOR_EACH_REV(&my_list, elem, { assert(elem->entry == --counter); });
+  // Nodes are relinked, not copied
+  assert(node->entry == 0 && node == my_list.head);
+  LIST_DESTROY(&my_list);
+
+  // Equal elements keep their order
+  struct list_sentinal_record records = new_list(record, NULL);
+  for (int i = 0; i < 100; i++) {
+    record *r = LIST_EMPLACE_APPEND(&records);
+    r->id = (100 - i) % 3;
+    r->payload[0] = i;
+  }
+  LIST_SORT(&records, RECORD_CMP);
+  LIST_FOR_EACH(&records, elem, {
+    if (elem->next) {
+      assert(elem->entry.id <= elem->next->entry.id);
+      if (elem->entry.id == elem->next->entry.id)
+        assert(elem->entry.payload[0] < elem->next->entry.payload[0]);
+    }
+  });
+  LIST_DESTROY(&records);
+
+  // Functions work as well as macros
+  char *strs[] = {"b", "c", "a"};
+  struct list_sentinal__str str_list = new_list(_str, NULL);
+  LIST_APPEND_ARRAY(&str_list, strs, 3);
+  LIST_SORT(&str_list, strcmp);
+  assert(!strcmp(str_list.head->entry, "a"));
+  assert(!strcmp(str_list.tail->entry, "c"));
+  LIST_DESTROY(&str_list);
+  return 0;
+}
+
+int cache_test() {
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  LIST_SET_CACHE_CAPACITY(&my_list, 2);
+  for (int i = 0; i < 4; i++)
+    LIST_APPEND(&my_list, i);
+
+  // FIFO use recycles the node popped last
+  for (int i = 4; i < 100; i++) {
+    struct list_int *head = my_list.head;
+    assert(LIST_POPF(&my_list) == i - 4);
+    assert(my_list.cache == head && my_list.cache_length == 1);
+    LIST_APPEND(&my_list, i);
+    assert(my_list.tail == head && !my_list.cache_length);
+  }
+
+  // The cache never grows past its capacity
+  LIST_FOR_EACH_SAFE(&my_list, elem, temp, {
+    if (elem != my_list.tail)
+      LIST_DEL(&my_list, elem);
+  });
+  assert(my_list.cache_length == 2);
+  LIST_SET_CACHE_CAPACITY(&my_list, 1);
+  assert(my_list.cache_length == 1);
+  LIST_SHRINK(&my_list);
+  assert(!my_list.cache && !my_list.cache_length);
+  assert(my_list.cache_capacity == 1);
+
+  // Cached bulk nodes keep their slab alive until released
+  int array[] = {1, 2, 3};
+  LIST_APPEND_ARRAY(&my_list, array, 3);
+  while (my_list.length)
+    LIST_POPB(&my_list);
+  assert(my_list.cache_length == 1 && my_list.cache->slab->live == 1);
+  LIST_DESTROY(&my_list);
+  assert(!my_list.cache && !my_list.bulk);
+
+  // ... even once the rest of the slab has been spliced into another list
+  struct list_sentinal_int a = new_list(int, NULL);
+  struct list_sentinal_int b = new_list(int, NULL);
+  int arr[] = {1, 2, 3, 4};
+  LIST_SET_CACHE_CAPACITY(&a, 8);
+  LIST_APPEND_ARRAY(&a, arr, 4);
+  LIST_POPF(&a);
+  LIST_SPLICE(&b, &a);
+  LIST_DESTROY(&b);
+  assert(a.cache_length == 1 && a.cache->slab->live == 1);
+  LIST_DESTROY(&a);
+  return 0;
+}
+
+int at_test() {
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  assert(!LIST_AT(&my_list, 0));
+  for (int i = 0; i < 100; i++)
+    LIST_APPEND(&my_list, i);
+  assert(!LIST_AT(&my_list, 100));
+
+  assert(LIST_AT(&my_list, 0) == my_list.head);
+  assert(LIST_AT(&my_list, 99) == my_list.tail);
+  for (int i = 0; i < 100; i++) {
+    assert(LIST_AT(&my_list, i)->entry == i);
+    assert(my_list.finger_index == (size_t)i);
+  }
+  for (int i = 99; i >= 0; i -= 7)
+    assert(LIST_AT(&my_list, i)->entry == i);
+
+  // Appends keep the finger, prepends shift it
+  LIST_AT(&my_list, 50);
+  LIST_APPEND(&my_list, 100);
+  assert(my_list.finger && my_list.finger_index == 50);
+  LIST_PREPEND(&my_list, -1);
+  assert(my_list.finger && my_list.finger_index == 51);
+  assert(LIST_AT(&my_list, 51)->entry == 50);
+  assert(LIST_AT(&my_list, 52)->entry == 51);
+  struct list_int *victim = my_list.tail->prev;
+  LIST_DEL(&my_list, victim);
+  assert(!my_list.finger);
+
+  assert(LIST_INSERT_AT(&my_list, 0, -2) == 102);
+  assert(LIST_INSERT_AT(&my_list, 102, 100) == 103);
+  assert(LIST_INSERT_AT(&my_list, 10, 1000) == 104);
+  assert(my_list.head->entry == -2 && my_list.tail->entry == 100);
+  assert(LIST_AT(&my_list, 10)->entry == 1000);
+  assert(LIST_AT(&my_list, 9)->entry == 7);
+  assert(LIST_AT(&my_list, 11)->entry == 8);
+  int counter = 0;
+  LIST_FOR_EACH_REV(&my_list, elem, { counter++; });
+  assert(counter == 104);
+  LIST_DESTROY(&my_list);
+  return 0;
+}
+
+int indexed_test() {
+  struct list_indexed_kv map = new_indexed_list(kv, NULL);
+  assert(!LIST_FIND(kv, &map, 0));
+  for (int i = 0; i < 1000; i++) {
+    struct list_kv *node = LIST_INDEXED_APPEND(kv, &map, ((kv){i, i * 2}));
+    assert(node == map.list.tail);
+  }
+  struct list_kv *node = LIST_INDEXED_PREPEND(kv, &map, ((kv){-1, 0}));
+  assert(node == map.list.head);
+  // Keys are unique
+  assert(!LIST_INDEXED_APPEND(kv, &map, ((kv){5, 0})));
+  assert(map.list.length == 1001);
+  assert(map.capacity >= 2002);
+
+  for (int i = -1; i < 1000; i++)
+    assert(LIST_FIND(kv, &map, i)->entry.key == i);
+  assert(!LIST_FIND(kv, &map, 1000));
+
+  // Deleting keeps every other key reachable
+  for (int i = 0; i < 1000; i += 3)
+    assert(LIST_DEL_KEY(kv, &map, i));
+  assert(!LIST_DEL_KEY(kv, &map, 0));
+  for (int i = 0; i < 1000; i++) {
+    struct list_kv *found = LIST_FIND(kv, &map, i);
+    if (i % 3)
+      assert(found && found->entry.value == i * 2);
+    else
+      assert(!found);
+  }
+  assert(map.list.length == 667);
+
+  node = LIST_FIND(kv, &map, 1);
+  LIST_INDEXED_REMOVE(kv, &map, node);
+  assert(!LIST_FIND(kv, &map, 1));
+  LIST_NODE_FREE(&map.list, node);
+  node = LIST_FIND(kv, &map, -1);
+  LIST_INDEXED_DEL(kv, &map, node);
+  assert(map.list.head->entry.key == 2);
+
+  int counter = 0;
+  LIST_FOR_EACH(&map.list, elem, { counter++; });
+  assert(counter == 665);
+  LIST_INDEXED_DESTROY(kv, &map);
+  assert(!map.list.length && !map.slots);
+  return 0;
+}
+
+int kv_evicted;
+void kv_destroy(kv elem) { kv_evicted += elem.value; }
+
+int lru_test() {
+  struct lru_kv cache;
+  kv_evicted = 0;
+  LRU_INIT(kv, &cache, 3, kv_destroy);
+  assert(!LRU_GET(kv, &cache, 1));
+  assert(cache.misses == 1);
+
+  LRU_PUT(kv, &cache, ((kv){1, 1}));
+  LRU_PUT(kv, &cache, ((kv){2, 2}));
+  LRU_PUT(kv, &cache, ((kv){3, 4}));
+  assert(LRU_GET(kv, &cache, 1)->value == 1);
+  assert(cache.index.list.head->entry.key == 1);
+  assert(cache.hits == 1);
+
+  // 2 is now least recently used
+  struct list_kv *lru_node = cache.index.list.tail;
+  assert(lru_node->entry.key == 2);
+  LRU_PUT(kv, &cache, ((kv){4, 8}));
+  assert(kv_evicted == 2);
+  assert(!LRU_GET(kv, &cache, 2));
+  assert(cache.index.list.length == 3);
+  // The evicted node was reused for the new element
+  assert(cache.index.list.head == lru_node);
+
+  // Replacing keeps the length and destroys the old value
+  kv *elem = LRU_PUT(kv, &cache, ((kv){3, 16}));
+  assert(elem->value == 16 && kv_evicted == 6);
+  assert(cache.index.list.length == 3);
+  int expected[] = {3, 4, 1};
+  int counter = 0;
+  LIST_FOR_EACH(&cache.index.list, node, {
+    assert(node->entry.key == expected[counter]);
+    counter++;
+  });
+
+  LRU_DESTROY(kv, &cache);
+  assert(kv_evicted == 6 + 16 + 8 + 1);
+  return 0;
+}
+
+int prefetch_test() {
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  for (int i = 0; i < 20; i++)
+    LIST_APPEND(&my_list, i);
+
+  size_t distances[] = {0, 1, 8, 19, 20, 100};
+  for (size_t d = 0; d < sizeof(distances) / sizeof(distances[0]); d++) {
+    int counter = 0;
+    LIST_FOR_EACH_PREFETCH(&my_list, elem, distances[d],
+                           { assert(elem->entry == counter++); });
+    assert(counter == 20);
+    LIST_FOR_EACH_REV_PREFETCH(&my_list, elem, distances[d],
+                               { assert(elem->entry == --counter); });
+    assert(counter == 0);
+  }
+  LIST_DESTROY(&my_list);
+  LIST_FOR_EACH_PREFETCH(&my_list, elem, 4, { assert(0); });
+  return 0;
+}
+
+int compact_test() {
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  LIST_COMPACT(&my_list);
+  assert(!my_list.head && !my_list.bulk);
+
+  // Interleave with a second list so the nodes are not adjacent
+  struct list_sentinal_int other = new_list(int, NULL);
+  for (int i = 0; i < 100; i++) {
+    LIST_APPEND(&my_list, i);
+    LIST_APPEND(&other, i);
+  }
+  LIST_FOR_EACH_SAFE(&my_list, elem, temp, {
+    if (elem->entry % 4 == 1)
+      LIST_DEL(&my_list, elem);
+  });
+  struct list_int *fourth = LIST_AT(&my_list, 3);
+
+  int moved = 0;
+  struct list_int *fourth_moved = NULL;
+  LIST_COMPACT_MAP(&my_list, old, new, {
+    assert(old->entry == new->entry);
+    if (old == fourth)
+      fourth_moved = new;
+    moved++;
+  });
+  assert(moved == 75);
+  assert(!my_list.finger);
+  assert(fourth_moved && fourth_moved->entry == 4);
+  assert(fourth_moved == my_list.head + 3);
+
+  int counter = 0;
+  LIST_FOR_EACH(&my_list, elem, {
+    assert(elem == my_list.head + counter);
+    assert(elem->entry % 4 != 1);
+    counter++;
+  });
+  assert(counter == 75 && my_list.tail == my_list.head + 74);
+  LIST_FOR_EACH_REV(&my_list, elem, { counter--; });
+  assert(!counter);
+
+  // Compacting a slab list releases the old slab
+  LIST_DEL(&my_list, fourth_moved);
+  LIST_COMPACT(&my_list);
+  assert(my_list.head->slab && my_list.head->slab == my_list.tail->slab);
+  assert(my_list.head->slab->live == 74);
+  assert(my_list.length == 74);
+
+  LIST_DESTROY(&my_list);
+  LIST_DESTROY(&other);
+  return 0;
+}
+
+int deque_test() {
+  struct deque_int my_deque = new_deque(int, NULL);
+  DEQUE_FOR_EACH(&my_deque, elem, { assert(!elem); });
+  assert(!DEQUE_AT(&my_deque, 0));
+
+  // Prepending before the first append wraps start around the buffer
+  for (int i = 1; i <= 10; i++)
+    DEQUE_PREPEND(&my_deque, -i);
+  for (int i = 0; i < 30; i++)
+    assert(DEQUE_APPEND(&my_deque, i) == (size_t)i + 11);
+  assert(my_deque.length == 40);
+  assert(my_deque.capacity == 64);
+
+  int counter = -10;
+  DEQUE_FOR_EACH(&my_deque, elem, {
+    assert(elem->entry == counter);
+    counter++;
+  });
+  assert(counter == 30);
+  DEQUE_FOR_EACH_REV(&my_deque, elem, {
+    counter--;
+    assert(elem->entry == counter);
+  });
+  assert(counter == -10);
+  assert(DEQUE_AT(&my_deque, 10)->entry == 0);
+  assert(!DEQUE_AT(&my_deque, 40));
+
+  for (int i = -10; i < 0; i++)
+    assert(DEQUE_POPF(&my_deque) == i);
+  for (int i = 29; i >= 20; i--)
+    assert(DEQUE_POPB(&my_deque) == i);
+  assert(my_deque.length == 20);
+
+  // Growing while wrapped keeps the order
+  int array[100];
+  for (int i = 0; i < 100; i++)
+    array[i] = 20 + i;
+  DEQUE_APPEND_ARRAY(&my_deque, array, 100);
+  assert(my_deque.length == 120);
+  assert(my_deque.capacity == 128);
+  counter = 0;
+  DEQUE_FOR_EACH(&my_deque, elem, {
+    assert(elem->entry == counter);
+    counter++;
+  });
+  assert(counter == 120);
+  DEQUE_DESTROY(&my_deque);
+  assert(!my_deque.buffer && !my_deque.length && !my_deque.capacity);
+
+  void str_destroy(char *str) { free(str); }
+  struct deque__str str_deque = new_deque(_str, str_destroy);
+  for (int i = 0; i < 20; i++)
+    DEQUE_APPEND(&str_deque, strdup("x"));
+  char *popped = DEQUE_POPF(&str_deque);
+  free(popped);
+  DEQUE_DESTROY(&str_deque);
+
+  struct list_pool pool;
+  list_pool_init(&pool, sizeof(int), 4);
+  struct deque_int pooled = new_deque_alloc(int, NULL, &pool.allocator);
+  for (int i = 0; i < 50; i++)
+    DEQUE_PREPEND(&pooled, i);
+  assert(DEQUE_POPB(&pooled) == 0);
+  DEQUE_DESTROY(&pooled);
+  list_pool_destroy(&pool);
+  return 0;
+}
+
+int parallel_test() {
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  // No ranges to split on an empty list
+  LIST_PARALLEL_FOR_EACH(&my_list, elem, 4, { assert(!elem); });
+
+  for (int i = 0; i < 1003; i++)
+    LIST_APPEND(&my_list, i);
+  long sum = 0;
+  LIST_PARALLEL_FOR_EACH(&my_list, elem, 4, {
+    elem->entry *= 2;
+    __atomic_add_fetch(&sum, elem->entry, __ATOMIC_RELAXED);
+  });
+  assert(sum == 1002 * 1003);
+  int counter = 0;
+  LIST_FOR_EACH(&my_list, elem, {
+    assert(elem->entry == 2 * counter);
+    counter++;
+  });
+
+  // More threads than nodes
+  sum = 0;
+  struct list_sentinal_int small = new_list(int, NULL);
+  LIST_APPEND(&small, 5);
+  LIST_APPEND(&small, 6);
+  LIST_PARALLEL_FOR_EACH(&small, elem, 8, {
+    __atomic_add_fetch(&sum, elem->entry, __ATOMIC_RELAXED);
+  });
+  assert(sum == 11);
+
+  // Huge or negative thread counts are capped instead of overflowing
+  sum = 0;
+  LIST_PARALLEL_FOR_EACH(&my_list, elem, -1, {
+    __atomic_add_fetch(&sum, elem->entry, __ATOMIC_RELAXED);
+  });
+  assert(sum == 1002 * 1003);
+
+  struct deque_int my_deque = new_deque(int, NULL);
+  for (int i = 0; i < 1003; i++)
+    DEQUE_PREPEND(&my_deque, i);
+  sum = 0;
+  DEQUE_PARALLEL_FOR_EACH(&my_deque, elem, 4, {
+    __atomic_add_fetch(&sum, elem->entry, __ATOMIC_RELAXED);
+  });
+  assert(sum == 1002 * 1003 / 2);
+  sum = 0;
+  DEQUE_PARALLEL_FOR_EACH(&my_deque, elem, (size_t)-1, {
+    __atomic_add_fetch(&sum, elem->entry, __ATOMIC_RELAXED);
+  });
+  assert(sum == 1002 * 1003 / 2);
+
+  DEQUE_DESTROY(&my_deque);
+  LIST_DESTROY(&small);
+  LIST_DESTROY(&my_list);
+  return 0;
+}
+
+int destroy_calls;
+void count_destroy(int entry) { destroy_calls += entry; }
+
+int destroy_test() {
+  int array[100];
+  for (int i = 0; i < 100; i++)
+    array[i] = 1;
+
+  // Slab nodes, malloc'd nodes and cached nodes all go in one teardown
+  struct list_sentinal_int my_list = new_list(int, count_destroy);
+  LIST_SET_CACHE_CAPACITY(&my_list, 8);
+  LIST_APPEND_ARRAY(&my_list, array, 100);
+  for (int i = 0; i < 10; i++)
+    LIST_PREPEND(&my_list, 1);
+  for (int i = 0; i < 5; i++)
+    LIST_POPF(&my_list);
+  LIST_AT(&my_list, 50);
+  assert(my_list.cache_length == 5);
+  LIST_DESTROY(&my_list);
+  assert(destroy_calls == 105);
+  assert(!my_list.head && !my_list.tail && !my_list.length);
+  assert(!my_list.finger && !my_list.cache && !my_list.bulk);
+  assert(my_list.cache_capacity == 8);
+
+  // The list can be reused afterwards
+  LIST_APPEND(&my_list, 1);
+  assert(my_list.length == 1 && my_list.head == my_list.tail);
+  LIST_DESTROY(&my_list);
+  assert(destroy_calls == 106);
+
+  // Destroying one half of a split slab leaves the other half intact
+  struct list_sentinal_int other = new_list(int, NULL);
+  LIST_APPEND_ARRAY(&my_list, array, 100);
+  LIST_SPLIT(&my_list, LIST_AT(&my_list, 40), &other);
+  LIST_DESTROY(&my_list);
+  assert(destroy_calls == 146);
+  int sum = 0;
+  LIST_FOR_EACH(&other, elem, { sum += elem->entry; });
+  assert(sum == 60);
+  LIST_DESTROY(&other);
+
+  // Abandoning hands nothing back to the pool, which is released whole
+  struct list_pool pool;
+  list_pool_init(&pool, sizeof(struct list_int), 16);
+  struct list_sentinal_int pooled =
+      new_list_alloc(int, count_destroy, &pool.allocator);
+  LIST_SET_CACHE_CAPACITY(&pooled, 4);
+  for (int i = 0; i < 40; i++)
+    LIST_APPEND(&pooled, 1);
+  LIST_POPB(&pooled);
+  LIST_APPEND_ARRAY(&pooled, array, 10);
+  void *free_nodes = pool.free_nodes;
+  LIST_ABANDON(&pooled);
+  assert(destroy_calls == 146 + 49);
+  assert(pool.free_nodes == free_nodes);
+  assert(!pooled.head && !pooled.length && !pooled.cache && !pooled.bulk);
+  list_pool_destroy(&pool);
+  return 0;
+}
+
+size_t counted_allocs;
+void *counted_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  counted_allocs++;
+  return malloc(size);
+}
+void counted_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+int inline_test() {
+  struct list_sentinal_int plain = new_list(int, NULL);
+  assert(LIST_INLINE_SLOTS(&plain) == 0);
+
+  struct list_allocator counting = {counted_alloc, counted_free, NULL, 0};
+  struct list_sentinal_tiny my_list = new_list_alloc(tiny, NULL, &counting);
+  assert(LIST_INLINE_SLOTS(&my_list) == 4);
+
+  // The first four inserts stay inside the sentinal
+  for (int i = 0; i < 4; i++)
+    LIST_APPEND(&my_list, i);
+  assert(counted_allocs == 0);
+  LIST_FOR_EACH(&my_list, elem, {
+    assert(elem >= my_list.inline_nodes && elem < my_list.inline_nodes + 4);
+  });
+  LIST_APPEND(&my_list, 4);
+  assert(counted_allocs == 1);
+
+  // Freed slots are handed out again
+  struct list_tiny *second = my_list.head->next;
+  LIST_DEL(&my_list, second);
+  LIST_PREPEND(&my_list, -1);
+  assert(my_list.head == second);
+  assert(counted_allocs == 1);
+
+  // Elements leaving through a splice are moved off the inline slots
+  struct list_sentinal_tiny other = new_list_alloc(tiny, NULL, &counting);
+  LIST_APPEND(&other, 10);
+  LIST_SPLICE(&my_list, &other);
+  assert(counted_allocs == 2);
+  assert(!other.head && !other.length);
+  assert(my_list.tail->entry == 10);
+  assert(!_LIST_INLINE_OWNS(&other, my_list.tail));
+
+  // ... and through a split, starting at an inline node
+  int expected[] = {-1, 0, 2, 3, 4, 10};
+  LIST_SPLIT(&my_list, my_list.head->next, &other);
+  assert(my_list.length == 1 && other.length == 5);
+  assert(counted_allocs == 5);
+  int counter = 1;
+  LIST_FOR_EACH(&other, elem, {
+    assert(elem->entry == expected[counter]);
+    assert(!_LIST_INLINE_OWNS(&my_list, elem));
+    counter++;
+  });
+  assert(counter == 6);
+  assert(my_list.inline_used[0] + my_list.inline_used[1] +
+             my_list.inline_used[2] + my_list.inline_used[3] ==
+         1);
+
+  // Destroying clears every slot
+  LIST_DESTROY(&my_list);
+  for (int i = 0; i < 4; i++)
+    LIST_APPEND(&my_list, i);
+  assert(counted_allocs == 5);
+  LIST_DESTROY(&my_list);
+  LIST_DESTROY(&other);
+  return 0;
+}
+
+size_t hooked_bytes;
+void hook_alloc(void *ctx, void *ptr, size_t size) {
+  assert(ctx == &hooked_bytes && ptr);
+  hooked_bytes += size;
+}
+void hook_free(void *ctx, void *ptr, size_t size) {
+  assert(ctx == &hooked_bytes && ptr);
+  hooked_bytes -= size;
+}
+
+int stats_test() {
+  struct list_sentinal_int plain = new_list(int, NULL);
+  assert(!LIST_GET_STATS(&plain));
+
+  struct list_sentinal_traced my_list = new_list(traced, NULL);
+  struct list_stats *stats = LIST_GET_STATS(&my_list);
+  assert(stats && !stats->allocs && !stats->peak_length);
+  stats->on_alloc = hook_alloc;
+  stats->on_free = hook_free;
+  stats->ctx = &hooked_bytes;
+
+  LIST_SET_CACHE_CAPACITY(&my_list, 2);
+  for (int i = 0; i < 10; i++)
+    LIST_APPEND(&my_list, i);
+  traced array[5] = {0};
+  LIST_PREPEND_ARRAY(&my_list, array, 5);
+  assert(stats->allocs == 11 && stats->inserts == 15);
+  assert(stats->peak_length == 15);
+  assert(hooked_bytes == 15 * sizeof(struct list_traced));
+
+  // The first two released nodes go to the cache and come back from there
+  LIST_POPB(&my_list);
+  LIST_POPB(&my_list);
+  struct list_traced *tail = my_list.tail;
+  LIST_DEL(&my_list, tail);
+  assert(stats->pops == 2 && stats->dels == 1 && stats->frees == 1);
+  LIST_APPEND(&my_list, 1);
+  LIST_APPEND(&my_list, 2);
+  assert(stats->cache_hits == 2 && stats->allocs == 11);
+  assert(stats->peak_length == 15 && my_list.length == 14);
+
+  long sum = 0;
+  LIST_FOR_EACH(&my_list, elem, { sum += elem->entry; });
+  LIST_FOR_EACH_REV_PREFETCH(&my_list, elem, 2, { sum -= elem->entry; });
+  assert(!sum);
+  assert(stats->traversals == 2 && stats->visited == 28);
+
+  // Every node and the bulk slab are handed back
+  LIST_DESTROY(&my_list);
+  assert(stats->frees == stats->allocs);
+  assert(hooked_bytes == 0);
+  return 0;
+}
+
+int filter_test() {
+  struct list_sentinal_int my_list = new_list(int, count_destroy);
+  destroy_calls = 0;
+  for (int i = 0; i < 100; i++)
+    LIST_APPEND(&my_list, i);
+  LIST_AT(&my_list, 50);
+
+  // Drop the odd values, including the tail
+  assert(LIST_FILTER(&my_list, elem, elem->entry % 2 == 0) == 50);
+  assert(destroy_calls == 50 * 50);
+  assert(my_list.length == 50 && !my_list.finger);
+  assert(my_list.head->entry == 0 && my_list.tail->entry == 98);
+  int counter = 0;
+  LIST_FOR_EACH(&my_list, elem, {
+    assert(elem->entry == 2 * counter);
+    counter++;
+  });
+  assert(counter == 50);
+  LIST_FOR_EACH_REV(&my_list, elem, {
+    counter--;
+    assert(elem->entry == 2 * counter);
+  });
+
+  // Dropping the head and keeping everything
+  assert(LIST_FILTER(&my_list, elem, elem->entry) == 1);
+  assert(my_list.head->entry == 2 && !my_list.head->prev);
+  assert(LIST_FILTER(&my_list, elem, 1) == 0);
+  assert(my_list.length == 49);
+
+  LIST_MAP_INPLACE(&my_list, elem, elem->entry / 2);
+  assert(my_list.head->entry == 1 && my_list.tail->entry == 49);
+  long sum = LIST_REDUCE(&my_list, elem, acc, 0L, acc + elem->entry);
+  assert(sum == 49 * 50 / 2);
+  int max = LIST_REDUCE(&my_list, elem, acc, -1,
+                        elem->entry > acc ? elem->entry : acc);
+  assert(max == 49);
+
+  // Dropping everything leaves an empty list
+  destroy_calls = 0;
+  assert(LIST_FILTER(&my_list, elem, 0) == 49);
+  assert(destroy_calls == sum);
+  assert(!my_list.head && !my_list.tail && !my_list.length);
+  assert(LIST_REDUCE(&my_list, elem, acc, 7, acc + elem->entry) == 7);
+  LIST_DESTROY(&my_list);
+  return 0;
+}
+
+int save_test() {
+  struct list_sentinal_record my_list = new_list(record, NULL);
+  // Enough records for several write batches
+  for (int i = 0; i < 1000; i++) {
+    record *r = LIST_EMPLACE_APPEND(&my_list);
+    r->id = i;
+    memset(r->payload, i, sizeof(r->payload));
+  }
+  FILE *file = tmpfile();
+  int fd = fileno(file);
+  assert(!LIST_SAVE(&my_list, fd));
+
+  struct list_sentinal_record loaded = new_list(record, NULL);
+  assert(!LIST_LOAD(&loaded, fd));
+  assert(loaded.length == 1000);
+  // All nodes come from one slab, in order
+  assert(loaded.head->slab && loaded.head->slab == loaded.tail->slab);
+  assert(loaded.tail == loaded.head + 999);
+  struct list_record *other = my_list.head;
+  LIST_FOR_EACH(&loaded, elem, {
+    assert(!memcmp(&elem->entry, &other->entry, sizeof(record)));
+    other = other->next;
+  });
+
+  struct list_view_record view;
+  assert(!LIST_VIEW_OPEN(&view, fd));
+  fclose(file);
+  assert(view.length == 1000);
+  for (size_t i = 0; i < view.length; i++)
+    assert(view.entries[i].id == (int)i &&
+           view.entries[i].payload[251] == (char)i);
+  LIST_VIEW_CLOSE(&view);
+  assert(!view.entries && !view.map);
+
+  // Files of another type or garbage are rejected
+  file = tmpfile();
+  fd = fileno(file);
+  struct list_sentinal_int empty = new_list(int, NULL);
+  assert(!LIST_SAVE(&empty, fd));
+  struct list_view_int int_view;
+  assert(!LIST_VIEW_OPEN(&int_view, fd) && !int_view.length);
+  LIST_VIEW_CLOSE(&int_view);
+  assert(LIST_LOAD(&loaded, fd) == -1 && errno == EINVAL);
+  assert(loaded.length == 1000);
+  fclose(file);
+  file = tmpfile();
+  fputs("definitely not a list file", file);
+  fflush(file);
+  assert(LIST_VIEW_OPEN(&view, fileno(file)) == -1 && errno == EINVAL);
+  assert(!view.entries);
+  fclose(file);
+
+  LIST_DESTROY(&loaded);
+  LIST_DESTROY(&my_list);
+  return 0;
+}
+
+int array_test() {
+  int array[100];
+  for (int i = 0; i < 100; i++)
+    array[i] = i;
+  struct list_sentinal_int my_list = LIST_FROM_ARRAY(int, NULL, array, 100);
+  assert(my_list.length == 100);
+  assert(my_list.head->slab && my_list.head->slab == my_list.tail->slab);
+  assert(my_list.tail == my_list.head + 99);
+
+  // Scatter the nodes before copying them back out
+  for (int i = 0; i < 50; i++)
+    LIST_POPF(&my_list);
+  for (int i = 49; i >= 0; i--)
+    LIST_PREPEND(&my_list, i);
+  int copy[100] = {0};
+  assert(LIST_TO_ARRAY(&my_list, copy) == copy);
+  assert(!memcmp(copy, array, sizeof(array)));
+
+  struct list_sentinal_int empty = LIST_FROM_ARRAY(int, NULL, array, 0);
+  assert(!empty.head && !empty.length);
+  copy[0] = -1;
+  LIST_TO_ARRAY(&empty, copy);
+  assert(copy[0] == -1);
+
+  LIST_DESTROY(&my_list);
+  return 0;
+}
+
+int kernel_test() {
+  struct list_chunk_sentinal_int chunks = new_chunk_list(int, NULL);
+  for (int i = 1; i <= 100; i++)
+    LIST_CHUNK_APPEND(&chunks, i);
+  for (int i = 1; i <= 10; i++)
+    LIST_CHUNK_PREPEND(&chunks, -i);
+  assert(LIST_CHUNK_SUM(&chunks, 0L) == 5050 - 55);
+  assert(LIST_CHUNK_MIN(&chunks) == -10);
+  assert(LIST_CHUNK_MAX(&chunks) == 100);
+  assert(LIST_CHUNK_COUNT_IF(&chunks, x, x % 2 == 0) == 55);
+  assert(*LIST_CHUNK_FIND_EQ(&chunks, 77) == 77);
+  assert(*LIST_CHUNK_FIND_EQ(&chunks, -3) == -3);
+  assert(!LIST_CHUNK_FIND_EQ(&chunks, 0));
+  LIST_CHUNK_DESTROY(&chunks);
+  assert(!LIST_CHUNK_FIND_EQ(&chunks, 1));
+  assert(LIST_CHUNK_SUM(&chunks, 0) == 0);
+
+  // A wrapped deque is scanned as two runs
+  struct deque_int my_deque = new_deque(int, NULL);
+  for (int i = 0; i < 1000; i++)
+    DEQUE_APPEND(&my_deque, i);
+  for (int i = 0; i < 900; i++)
+    DEQUE_POPF(&my_deque);
+  for (int i = 1000; i < 1300; i++)
+    DEQUE_APPEND(&my_deque, i);
+  for (int i = 1; i <= 300; i++)
+    DEQUE_PREPEND(&my_deque, -i);
+  assert(my_deque.start + my_deque.length > my_deque.capacity);
+  assert(DEQUE_SUM(&my_deque, 0L) == 439800 - 45150);
+  assert(DEQUE_MIN(&my_deque) == -300);
+  assert(DEQUE_MAX(&my_deque) == 1299);
+  assert(DEQUE_COUNT_IF(&my_deque, x, x < 0) == 300);
+  // Matches on either side of the wrap and in the middle of a block
+  assert(*DEQUE_FIND_EQ(&my_deque, -300) == -300);
+  assert(*DEQUE_FIND_EQ(&my_deque, -37) == -37);
+  assert(DEQUE_FIND_EQ(&my_deque, 1133) == &DEQUE_AT(&my_deque, 533)->entry);
+  assert(!DEQUE_FIND_EQ(&my_deque, 0));
+  DEQUE_DESTROY(&my_deque);
+  assert(!DEQUE_FIND_EQ(&my_deque, 0));
+  assert(DEQUE_COUNT_IF(&my_deque, x, x > 0) == 0);
+  return 0;
+}
+
+int trivial_test() {
+  // No destructor is stored
+  assert(sizeof(struct list_sentinal_plain) ==
+         sizeof(struct list_sentinal_int) - sizeof(list_destructor_int));
+  assert(!_LIST_GET_DESTRUCTOR((struct list_sentinal_plain *)NULL));
+
+  struct list_sentinal_plain my_list = new_list(plain, NULL);
+#ifdef TRIVIAL_DESTRUCTOR_TEST
+  // Must fail with the static assert alone, see the Makefile
+  void drop(plain p) { (void)p; }
+  struct list_sentinal_plain rejected = new_list(plain, drop);
+  (void)rejected;
+#endif
+  plain array[10] = {0};
+  LIST_APPEND_ARRAY(&my_list, array, 10);
+  for (unsigned i = 0; i < 20; i++)
+    LIST_APPEND(&my_list, i);
+  struct list_plain *head = my_list.head;
+  LIST_DEL(&my_list, head);
+  assert(LIST_POPB(&my_list) == 19);
+  assert(LIST_FILTER(&my_list, elem, elem->entry % 2) == 19);
+  assert(my_list.length == 9);
+  LIST_DESTROY(&my_list);
+  assert(!my_list.head && !my_list.length);
+
+  struct list_pool pool;
+  list_pool_init(&pool, sizeof(struct list_plain), 8);
+  struct list_sentinal_plain pooled =
+      new_list_alloc(plain, NULL, &pool.allocator);
+  for (unsigned i = 0; i < 20; i++)
+    LIST_PREPEND(&pooled, i);
+  LIST_ABANDON(&pooled);
+  list_pool_destroy(&pool);
+
+  // Key indexed and LRU functions of trivial types store no destructor
+  struct lru_flat_kv cache;
+  LRU_INIT(flat_kv, &cache, 2, NULL);
+  LRU_PUT(flat_kv, &cache, ((flat_kv){1, 1}));
+  LRU_PUT(flat_kv, &cache, ((flat_kv){2, 2}));
+  LRU_PUT(flat_kv, &cache, ((flat_kv){3, 3}));
+  assert(!LRU_GET(flat_kv, &cache, 1));
+  assert(LRU_GET(flat_kv, &cache, 3)->value == 3);
+  LRU_DESTROY(flat_kv, &cache);
+  return 0;
+}
+
+int functions_test() {
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  for (int i = 0; i < 10; i++)
+    assert(list_append_int(&my_list, i) == (size_t)i + 1);
+  assert(list_prepend_int(&my_list, -1) == 11);
+  int array[3] = {10, 11, 12};
+  list_append_array_int(&my_list, array, 3);
+  list_prepend_array_int(&my_list, array, 3);
+  assert(my_list.length == 17);
+
+  // Arguments are evaluated once
+  list_del_int(&my_list, my_list.head);
+  list_del_int(&my_list, my_list.tail);
+  assert(list_popf_int(&my_list) == 11);
+  assert(list_popb_int(&my_list) == 11);
+  assert(list_at_int(&my_list, 1)->entry == -1);
+  assert(list_insert_at_int(&my_list, 2, 100) == 14);
+  struct list_int *node = list_at_int(&my_list, 2);
+  list_remove_int(&my_list, node);
+  LIST_NODE_FREE(&my_list, node);
+
+  struct list_sentinal_int other = new_list(int, NULL);
+  assert(list_split_int(&my_list, list_at_int(&my_list, 5), &other) == 8);
+  list_compact_int(&other);
+  assert(list_splice_int(&my_list, &other) == 13);
+  int expected[] = {10, -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  int counter = 0;
+  LIST_FOR_EACH(&my_list, elem, {
+    assert(elem->entry == expected[counter]);
+    counter++;
+  });
+  assert(counter == 13);
+  list_destroy_int(&my_list);
+  assert(!my_list.head && !my_list.length);
+  return 0;
+}
+
+#define RCU_READERS 3
+#define RCU_ITEMS 20000
+
+struct list_epoch rcu_epoch;
+struct list_rcu_int rcu_list;
+int rcu_done;
+
+void *rcu_reader(void *arg) {
+  size_t slot = *(size_t *)arg;
+  while (!__atomic_load_n(&rcu_done, __ATOMIC_ACQUIRE)) {
+    // The writer only appends larger values and deletes from the head
+    int last = 0;
+    LIST_RCU_READ_LOCK(&rcu_list, slot);
+    LIST_RCU_FOR_EACH(&rcu_list, elem, {
+      assert(elem->entry > last);
+      last = elem->entry;
+    });
+    LIST_RCU_READ_UNLOCK(&rcu_list, slot);
+  }
+  return NULL;
+}
+
+int rcu_test() {
+  assert(!list_epoch_init(&rcu_epoch, RCU_READERS));
+  rcu_list = new_rcu_list(int, count_destroy, &rcu_epoch);
+  destroy_calls = 0;
+  pthread_t threads[RCU_READERS];
+  size_t slots[RCU_READERS];
+  for (size_t i = 0; i < RCU_READERS; i++) {
+    slots[i] = i;
+    pthread_create(&threads[i], NULL, rcu_reader, &slots[i]);
+  }
+
+  long expected = 0;
+  for (int i = 1; i <= RCU_ITEMS; i++) {
+    LIST_RCU_APPEND(&rcu_list, i);
+    if (LIST_RCU_LENGTH(&rcu_list) > 16) {
+      expected += rcu_list.head->entry;
+      struct list_int *head = rcu_list.head;
+      LIST_RCU_DEL(&rcu_list, head);
+    }
+  }
+  __atomic_store_n(&rcu_done, 1, __ATOMIC_RELEASE);
+  for (int i = 0; i < RCU_READERS; i++)
+    pthread_join(threads[i], NULL);
+  assert(LIST_RCU_LENGTH(&rcu_list) == 16);
+
+  // With every reader gone all retired nodes can be freed
+  LIST_RCU_RECLAIM(&rcu_list);
+  assert(!rcu_list.retired_length);
+  for (size_t b = 0; b < _LIST_RCU_BUCKETS; b++)
+    assert(!rcu_list.retired[b]);
+  assert(destroy_calls == expected);
+
+  // Readers on a deleted node still see it until they unlock
+  LIST_RCU_PREPEND(&rcu_list, -1);
+  LIST_RCU_READ_LOCK(&rcu_list, 0);
+  struct list_int *first = __atomic_load_n(&rcu_list.head, __ATOMIC_ACQUIRE);
+  LIST_RCU_DEL(&rcu_list, first);
+  assert(rcu_list.retired_length == 1 && !LIST_RCU_RECLAIM(&rcu_list));
+  assert(first->entry == -1 && first->next == rcu_list.head);
+  LIST_RCU_READ_UNLOCK(&rcu_list, 0);
+  assert(LIST_RCU_RECLAIM(&rcu_list) == 1);
+  assert(destroy_calls == expected - 1);
+
+  // Readers that keep overlapping still let older retired nodes go
+  long freed = destroy_calls;
+  LIST_RCU_READ_LOCK(&rcu_list, 0);
+  for (size_t i = 0; i < 10; i++) {
+    freed += rcu_list.head->entry;
+    struct list_int *head = rcu_list.head;
+    LIST_RCU_DEL(&rcu_list, head);
+    LIST_RCU_READ_LOCK(&rcu_list, (i + 1) % 2);
+    LIST_RCU_READ_UNLOCK(&rcu_list, i % 2);
+    assert(rcu_list.retired_length <= 2);
+  }
+  LIST_RCU_READ_UNLOCK(&rcu_list, 0);
+  LIST_RCU_RECLAIM(&rcu_list);
+  assert(!rcu_list.retired_length && destroy_calls == freed);
+
+  LIST_RCU_DESTROY(&rcu_list);
+  assert(!rcu_list.head && !rcu_list.tail && !LIST_RCU_LENGTH(&rcu_list));
+  assert(destroy_calls == (long)RCU_ITEMS * (RCU_ITEMS + 1) / 2 - 1);
+  list_epoch_destroy(&rcu_epoch);
+  return 0;
+}
+
+int batch_test() {
+  struct list_sentinal_int my_list = new_list(int, count_destroy);
+  for (int i = 0; i < 10; i++)
+    LIST_APPEND(&my_list, i);
+
+  // Entries come out in the order repeated pops would return them
+  int out[8];
+  LIST_AT(&my_list, 5);
+  assert(LIST_POPF_N(&my_list, 3, out) == 3);
+  assert(out[0] == 0 && out[1] == 1 && out[2] == 2);
+  assert(my_list.length == 7 && my_list.head->entry == 3);
+  assert(!my_list.head->prev && !my_list.finger);
+  assert(LIST_POPB_N(&my_list, 2, out) == 2);
+  assert(out[0] == 9 && out[1] == 8);
+  assert(my_list.length == 5 && my_list.tail->entry == 7);
+  assert(!my_list.tail->next);
+
+  // Detached sublists keep their order and the list's destructor
+  struct list_sentinal_int front = LIST_DETACHF_N(&my_list, 2);
+  struct list_sentinal_int back = LIST_DETACHB_N(&my_list, 2);
+  assert(front.length == 2 && front.head->entry == 3 && front.tail->entry == 4);
+  assert(back.length == 2 && back.head->entry == 6 && back.tail->entry == 7);
+  assert(!front.tail->next && !back.head->prev);
+  assert(my_list.length == 1 && my_list.head == my_list.tail);
+  assert(my_list.head->entry == 5);
+  destroy_calls = 0;
+  LIST_DESTROY(&front);
+  assert(destroy_calls == 7);
+
+  // Asking for more than the list holds takes everything
+  assert(LIST_POPF_N(&my_list, 8, out) == 1 && out[0] == 5);
+  assert(!my_list.head && !my_list.tail && !my_list.length);
+  assert(LIST_POPB_N(&my_list, 8, out) == 0);
+  struct list_sentinal_int none = LIST_DETACHF_N(&my_list, 4);
+  assert(!none.head && !none.length);
+  struct list_sentinal_int all = LIST_DETACHB_N(&back, 4);
+  assert(all.length == 2 && !back.head && !back.tail && !back.length);
+  LIST_DESTROY(&all);
+  assert(destroy_calls == 20);
+
+  // Nodes of a bulk slab can be detached and destroyed independently
+  int array[] = {1, 2, 3, 4, 5, 6};
+  LIST_APPEND_ARRAY(&my_list, array, 6);
+  struct list_sentinal_int half = LIST_DETACHF_N(&my_list, 3);
+  LIST_DESTROY(&my_list);
+  assert(half.tail->entry == 3);
+  LIST_DESTROY(&half);
+
+  // Detached elements are moved off the inline slots
+  struct list_sentinal_tiny inline_list = new_list(tiny, NULL);
+  for (int i = 0; i < 6; i++)
+    LIST_APPEND(&inline_list, i);
+  struct list_sentinal_tiny taken = LIST_DETACHF_N(&inline_list, 3);
+  int counter = 0;
+  LIST_FOR_EACH(&taken, elem, {
+    assert(elem->entry == counter++);
+    assert(!_LIST_INLINE_OWNS(&inline_list, elem));
+  });
+  assert(counter == 3);
+  assert(inline_list.inline_used[0] + inline_list.inline_used[1] +
+             inline_list.inline_used[2] + inline_list.inline_used[3] ==
+         1);
+  tiny rest[4];
+  assert(LIST_POPB_N(&inline_list, 4, rest) == 3);
+  assert(rest[0] == 5 && rest[2] == 3);
+  assert(!inline_list.inline_used[0] && !inline_list.inline_used[3]);
+  LIST_DESTROY(&taken);
+  LIST_DESTROY(&inline_list);
+
+  // Neither detaching nor splitting allocates, however many slabs there are
+  struct list_allocator counting = {counted_alloc, counted_free, NULL, 0};
+  struct list_sentinal_int slabbed = new_list_alloc(int, NULL, &counting);
+  for (int i = 0; i < 4; i++)
+    LIST_APPEND_ARRAY(&slabbed, array, 6);
+  size_t allocs = counted_allocs;
+  struct list_sentinal_int first = LIST_DETACHF_N(&slabbed, 9);
+  struct list_sentinal_int tail_half = new_list_alloc(int, NULL, &counting);
+  LIST_SPLIT(&slabbed, slabbed.head->next->next->next, &tail_half);
+  assert(counted_allocs == allocs);
+  assert(first.length == 9 && slabbed.length == 3 && tail_half.length == 12);
+  LIST_DESTROY(&slabbed);
+  LIST_DESTROY(&first);
+  LIST_DESTROY(&tail_half);
+  return 0;
+}
+
+int memory_test() {
+  size_t node = sizeof(struct list_int);
+  size_t overhead = list_allocator_overhead(NULL, node);
+  assert(overhead >= sizeof(size_t));
+
+  struct list_sentinal_int my_list = new_list(int, NULL);
+  for (int i = 0; i < 10; i++)
+    LIST_APPEND(&my_list, i);
+  struct list_memory usage = LIST_MEMORY_USAGE(&my_list);
+  assert(usage.payload == 10 * sizeof(int));
+  assert(usage.links == 10 * node - usage.payload + sizeof(my_list));
+  assert(usage.allocator == 10 * overhead);
+  assert(usage.slack == 0);
+
+  // Cached nodes and freed nodes of bulk slabs are slack
+  LIST_SET_CACHE_CAPACITY(&my_list, 2);
+  LIST_POPF(&my_list);
+  LIST_POPF(&my_list);
+  LIST_POPF(&my_list);
+  int array[8] = {0};
+  LIST_APPEND_ARRAY(&my_list, array, 8);
+  LIST_POPB(&my_list);
+  usage = LIST_MEMORY_USAGE(&my_list);
+  assert(usage.payload == 14 * sizeof(int));
+  assert(usage.slack == 2 * node + node);
+  assert(usage.allocator > 9 * overhead + _LIST_SLAB_HEADER);
+  LIST_DESTROY(&my_list);
+
+  // Pool nodes cost the pool's node size
+  struct list_pool pool;
+  list_pool_init(&pool, node, 16);
+  struct list_sentinal_int pooled = new_list_alloc(int, NULL, &pool.allocator);
+  LIST_APPEND(&pooled, 1);
+  usage = LIST_MEMORY_USAGE(&pooled);
+  assert(usage.allocator == pool.node_size - node);
+  LIST_DESTROY(&pooled);
+  list_pool_destroy(&pool);
+
+  // Other allocators are costed by their block size, or as free of overhead
+  struct list_allocator blocks = {counted_alloc, counted_free, NULL, 64};
+  assert(list_allocator_overhead(&blocks, node) == 64 - node);
+  assert(list_allocator_overhead(&blocks, 100) ==
+         list_allocator_overhead(NULL, 100));
+  blocks.block_size = 0;
+  assert(list_allocator_overhead(&blocks, node) == 0);
+
+  // Free inline slots are slack, inline nodes have no allocator overhead
+  struct list_sentinal_tiny inline_list = new_list(tiny, NULL);
+  LIST_APPEND(&inline_list, 1);
+  usage = LIST_MEMORY_USAGE(&inline_list);
+  assert(usage.slack == 3 * sizeof(struct list_tiny));
+  assert(usage.allocator == 0);
+  assert(usage.links == sizeof(struct list_tiny) - sizeof(tiny) +
+                            sizeof(inline_list) -
+                            sizeof(inline_list.inline_nodes));
+  LIST_DESTROY(&inline_list);
+
+  struct list_chunk_sentinal_int chunks = new_chunk_list(int, NULL);
+  for (int i = 0; i < 20; i++)
+    LIST_CHUNK_APPEND(&chunks, i);
+  usage = LIST_CHUNK_MEMORY_USAGE(&chunks);
+  assert(usage.payload == 20 * sizeof(int));
+  assert(usage.slack == 2 * sizeof(chunks.head->entries) - usage.payload);
+  assert(usage.allocator ==
+         2 * list_allocator_overhead(NULL, sizeof(*chunks.head)));
+
+  struct deque_int deque = new_deque(int, NULL);
+  struct list_memory total = DEQUE_MEMORY_USAGE(&deque);
+  assert(total.payload == 0 && total.slack == 0 && total.allocator == 0);
+  for (int i = 0; i < 20; i++)
+    DEQUE_APPEND(&deque, i);
+  usage = DEQUE_MEMORY_USAGE(&deque);
+  assert(usage.payload == 20 * sizeof(int));
+  assert(usage.slack == (deque.capacity - 20) * sizeof(int));
+
+  // Footprints of different types add up
+  list_memory_add(&total, usage);
+  list_memory_add(&total, LIST_CHUNK_MEMORY_USAGE(&chunks));
+  assert(total.payload == 40 * sizeof(int));
+  assert(list_memory_total(total) ==
+         list_memory_total(usage) +
+             list_memory_total(LIST_CHUNK_MEMORY_USAGE(&chunks)) +
+             sizeof(deque));
+  LIST_CHUNK_DESTROY(&chunks);
+  DEQUE_DESTROY(&deque);
+  return 0;
+}
+
 int main() {
   puts("Make sure to run all tests with valgrind!");
   TEST(definitions_test);
   TEST(int_test);
   TEST(str_test);
+  TEST(pool_test);
+  TEST(bulk_test);
+  TEST(chunk_test);
+  TEST(intrusive_test);
+  TEST(emplace_test);
+  TEST(splice_test);
+  TEST(mpsc_test);
+  TEST(sort_test);
+  TEST(cache_test);
+  TEST(at_test);
+  TEST(indexed_test);
+  TEST(lru_test);
+  TEST(prefetch_test);
+  TEST(compact_test);
+  TEST(deque_test);
+  TEST(parallel_test);
+  TEST(destroy_test);
+  TEST(inline_test);
+  TEST(stats_test);
+  TEST(filter_test);
+  TEST(save_test);
+  TEST(array_test);
+  TEST(kernel_test);
+  TEST(trivial_test);
+  TEST(functions_test);
+  TEST(rcu_test);
+  TEST(batch_test);
+  TEST(memory_test);
   return 0;
 }